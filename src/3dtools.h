@@ -107,118 +107,218 @@ inline int computeSIFT(string imagename, Eigen::Vector2d pos, Eigen::VectorXd &o
 
 
 /*!
-	 * Checks whether the reference and the pointToTest have similar SIFT descriptors for their most frontoparallel view. Called from latticeDetector.
+	 * Loads an image as grayscale, as needed for the SIFT computation.
 	 *
-	 * @param[in] referencePoint the first point to check (in 3D)
-	 * @param[in] pointToTest the second point to check (in 3D)
-	 * @param[in] plane the array to store the computed SIFT descriptor
-	 * @param[in] K intrinsic camera matrix (to calculate projections)
-	 * @param[in] camPoses all the poses of the cameras in the dataset
-	 * @param[in] viewIds the corresponding index to the image directory
-	 * @param[in] imageNames an array containing the image names
-	 * @return	true if the points have similar SIFT
+	 * @param[in] imagename name of the image. Must be the path after the "data/" directory
+	 * @return	the grayscale image. Empty if the image could not be read.
 	 */
-inline bool compareSiftFronto(Eigen::Vector3d const &referencePoint, Eigen::Vector3d const &pointToTest,
-		Eigen::Vector4d plane,
-		Eigen::Matrix3d K, vector<Eigen::Matrix<double,3,4>> camPoses, vector<int> viewIds,  vector<string> imageNames ){
+inline cv::Mat loadGrayscaleImage(string imagename)
+{
+    cv::Mat input = cv::imread("data/"+imagename, 0); //Load as grayscale
+
+    if(! input.data )                              // Check for invalid input
+        {
+            cout <<  "Could not open or find the image" << std::endl ;
+        }
+
+    return input;
+}
+
+/*!
+	 * Calculates the SIFT descriptors of several 2d points in one image, with a single SIFT run.
+	 *
+	 * @param[in] input grayscale image, as returned by loadGrayscaleImage
+	 * @param[in] positions 2d positions of the points
+	 * @param[out] outFeatureVectors the computed SIFT descriptors, one per position (in the same order)
+	 * @return	0 on success, -1 if the image is invalid or not every position got a descriptor
+	 */
+inline int computeSIFTBatch(cv::Mat const &input, vector<Eigen::Vector2d> const &positions, vector<Eigen::VectorXd> &outFeatureVectors)
+{
+    outFeatureVectors.clear();
+
+    if(! input.data )
+        {
+            return -1;
+        }
+    if(positions.empty())
+        {
+            return 0;
+        }
+
+    // create mask to search for nearby keypoints to use their size for our keypoint
+    cv::Mat mask;
+    input.copyTo(mask);
+    mask = cv::Scalar(0);
+
+    int KPsize = 9;
+
+    // one keypoint per position, all described by the same SIFT run
+    vector<cv::KeyPoint> myKeyPoints;
+    myKeyPoints.reserve(positions.size());
+    for(size_t k = 0; k<positions.size(); k++)
+    {
+        float x = positions[k](0);
+        float y = positions[k](1);
+        assert(x>0 && y>0 && x< input.cols && y < input.rows);
+        myKeyPoints.push_back(cv::KeyPoint(x, y, KPsize));
+    }
+
+    cv::SIFT siftDetector;
+    cv::Mat descriptor;
+
+    siftDetector(input,mask,myKeyPoints,descriptor, true);
+
+    // provided keypoints are described in order, one row each
+    if((size_t)descriptor.rows != positions.size())
+        {
+            return -1;
+        }
+
+    // convert descriptors to Eigen::VectorXd (column vectors)
+    outFeatureVectors.resize(positions.size());
+    for(int k = 0; k<descriptor.rows; k++)
+    {
+        Eigen::VectorXd outDescriptor(descriptor.cols,1);
+        for(int i = 0; i<descriptor.cols;i++)
+        {
+            outDescriptor(i) = descriptor.at<float>(k,i);
+        }
+        outFeatureVectors[k] = outDescriptor;
+    }
+
+    return 0;
+}
+
+/*!
+	 * Selects the most frontoparallel view of many 3d points, i.e. for every point the view whose camera-point line is most aligned
+	 * with the plane normal, among the views the point projects into. Every considered camera projects all points in one batch
+	 * (see CameraMatrix::projectPoints).
+	 *
+	 * @param[in] points the 3d points
+	 * @param[in] plane the plane the points lie on
+	 * @param[in] rig all the cameras in the dataset
+	 * @param[out] viewsOut the selected view of every point, or -1 if the point is not visible in any considered view
+	 * @param[out] pixelsOut the projection of every point into its selected view, (-1,-1) if there is none
+	 */
+inline void selectFrontoViews(PointArray const &points, Eigen::Vector4d const &plane, CameraRig const &rig,
+		vector<int> &viewsOut, vector<Vector2d> &pixelsOut){
 
 	//TODO: We use fixed image size (1696x1132). Must read img to check real...
 	float const w = 1696;
 	float const h = 1132;
 
-	CameraMatrix cam;
-	cam.setIntrinsic(K);
+	int count = points.rows();
+	VectorXd cosangles = VectorXd::Zero(count);
+	viewsOut.assign(count, -1);
+	pixelsOut.assign(count, Vector2d(-1,-1));
 
-	double cosangle = 0;
-	double tmpcosangle=0;
-	int bestview=-1;
-	Vector2d pbest(0,0);
-	Vector2d p;
+	Vector3d normal = plane.head(3);
+	ProjectedPoints projected;
 
 	//TODO: pose selection only for the three images that the lattices were extracted.
 	//Proposed paper method is weak.
-	for (size_t i=0; i<camPoses.size(); i++){
+	for (int i=0; i<rig.size(); i++){
 
 	//get view
-		int view = viewIds[i];
+		int view = rig.view(i);
 
 		if ((view < 45) || (view > 47))
 		{
 			continue;
 		}
 
-	//check angle between camera-point line and plane normal
-		Vector3d line = referencePoint - camPoses[i].block<3,1>(0,3);
+	//check angle between camera-point lines and plane normal
+		PointArray lines = points.rowwise() - rig.position(i).transpose();
 	//abs because we dont know the plane orientation
-		tmpcosangle = abs(line.dot(plane.head(3)))/sqrt(line.squaredNorm() * plane.head(3).squaredNorm());
-
-	//project point into image
-		cam.setOrientation(camPoses[i]);
-		p = cam.projectPoint(referencePoint);
+		ArrayXd tmpcosangles = (lines*normal).array().abs() / (lines.rowwise().squaredNorm() * normal.squaredNorm()).array().sqrt();
 
-		double d = cam.transformPointIntoCameraSpace(referencePoint)[2];
+	//project points into image
+		rig.camera(i).projectPoints(points, w, h, projected);
 
-		if ((d > 0) && (tmpcosangle > cosangle) && (p[0]>=0)&&(p[1]>=0)&& (p[0]<w)&&(p[1]<h)){
-			cosangle = tmpcosangle;
-			bestview = view;
-			pbest = p;			
+		for (int k = 0; k < count; k++){
+			if (projected.inImage(k) && (tmpcosangles(k) > cosangles(k))){
+				cosangles(k) = tmpcosangles(k);
+				viewsOut[k] = view;
+				pixelsOut[k] = projected.pixel(k);
+			}
 		}
 	}
+}
 
+/*!
+	 * Selects the most frontoparallel view of a 3d point, see selectFrontoViews.
+	 *
+	 * @param[in] point the 3d point
+	 * @param[in] plane the plane the point lies on
+	 * @param[in] rig all the cameras in the dataset
+	 * @param[out] pixelOut the projection of the point into the selected view
+	 * @return	the selected view, or -1 if the point is not visible in any considered view
+	 */
+inline int selectFrontoView(Eigen::Vector3d const &point, Eigen::Vector4d const &plane, CameraRig const &rig, Eigen::Vector2d &pixelOut){
 
-	Eigen::VectorXd s1;
-	computeSIFT(imageNames[bestview],pbest,s1);
+	vector<int> views;
+	vector<Vector2d> pixels;
+	selectFrontoViews(point.transpose(), plane, rig, views, pixels);
 
-	//==========================
+	pixelOut = pixels[0];
+	return views[0];
+}
 
-	cosangle = 0;
-	pbest[0]=-1;
-	pbest[1]=-1;
-	bestview = -1;
+/*!
+	 * Checks whether two SIFT descriptors are similar, i.e. the angle between them is below the tolerance of the paper.
+	 *
+	 * @param[in] s1 the first descriptor
+	 * @param[in] s2 the second descriptor
+	 * @return	true if the descriptors are similar
+	 */
+inline bool siftDescriptorsAreSimilar(Eigen::VectorXd const &s1, Eigen::VectorXd const &s2){
 
-	for (size_t i=0; i<camPoses.size(); i++){
+	if ((s1.size() == 0) || (s1.size() != s2.size())){
+		return false;
+	}
 
-		int view = viewIds[i];
+	double dotProduct = s1.dot(s2);
 
-		if ((view < 45) || (view > 47))
-				{
-					continue;
-				}
+	 //angle (in radians)
+	 double theta = acos(dotProduct/(s1.norm()*s2.norm()));
 
-	//check angle between camera-point line and plane normal
-		Vector3d line = pointToTest - camPoses[i].block<3,1>(0,3);
-	//abs because we dont know the plane orientation
-		tmpcosangle = abs(line.dot(plane.head(3)))/(line.norm()*plane.head(3).norm());
+	 return (theta) < 2*0.25; // 2*tol_angle from detectRepPoints. This threshold is defined by the paper.
+}
 
-	//project point into image
-		cam.setOrientation(camPoses[i]);
-		p = cam.projectPoint(pointToTest);
-		double d = cam.transformPointIntoCameraSpace(pointToTest)[2];
+/*!
+	 * Checks whether the reference and the pointToTest have similar SIFT descriptors for their most frontoparallel view.
+	 * Single-pair variant; latticeDetector validates whole sets of points per image instead (see LatticeDetector::arePointsValid).
+	 *
+	 * @param[in] referencePoint the first point to check (in 3D)
+	 * @param[in] pointToTest the second point to check (in 3D)
+	 * @param[in] plane the array to store the computed SIFT descriptor
+	 * @param[in] rig all the cameras in the dataset (to calculate projections)
+	 * @param[in] imageNames an array containing the image names
+	 * @return	true if the points have similar SIFT
+	 */
+inline bool compareSiftFronto(Eigen::Vector3d const &referencePoint, Eigen::Vector3d const &pointToTest,
+		Eigen::Vector4d plane, CameraRig const &rig, vector<string> const &imageNames ){
 
-		if ((d > 0)&&(tmpcosangle > cosangle) && (p[0]>=0)&&(p[1]>=0)&& (p[0]<w)&&(p[1]<h)){
-			cosangle = tmpcosangle;
-			bestview = view;
-			pbest = p;			
-		}
-	}
+	Vector2d pbest;
 
+	int bestview = selectFrontoView(referencePoint, plane, rig, pbest);
 	if (bestview == -1){
 		return false;
 	}
 
-	Eigen::VectorXd s2;
-	computeSIFT(imageNames[bestview],pbest,s2);
-
-	double dotProduct = s1.dot(s2);
+	Eigen::VectorXd s1;
+	computeSIFT(imageNames[bestview],pbest,s1);
 
-	 //angle (in radians)
-	 double theta = acos(dotProduct/(s1.norm()*s2.norm()));
+	//==========================
 
+	bestview = selectFrontoView(pointToTest, plane, rig, pbest);
+	if (bestview == -1){
+		return false;
+	}
 
-	 if ((theta) < 2*0.25) // 2*tol_angle from detectRepPoints. This threshold is defined by the paper.
-	 	 return true;
-	 else
-		 return false;
+	Eigen::VectorXd s2;
+	computeSIFT(imageNames[bestview],pbest,s2);
 
+	return siftDescriptorsAreSimilar(s1, s2);
 }
 #endif // TOOLs_H
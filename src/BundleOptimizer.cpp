@@ -10,17 +10,15 @@
 #include "ceres/ceres.h"
 
 
-BundleOptimizer::BundleOptimizer(list<list<LatticeClass> > &aConsolidatedLattices, inputManager &inpM) {
+BundleOptimizer::BundleOptimizer(ConsolidatedLattices &aConsolidatedLattices, inputManager &inpM) : consolidatedLattices(aConsolidatedLattices) {
 
 	allPoints = &(inpM.pointModel);
 	camViewIndices = inpM.getViewIds();
 
 	number_of_cams = inpM.getCamPoses().size();
 
-	consolidatedLattices = list<list<LatticeClass> >(aConsolidatedLattices);
-	numConsolidatedLattices = consolidatedLattices.size();
-
-	initNumLattices();
+	numConsolidatedLattices = consolidatedLattices.groupCount();
+	num_lattices = consolidatedLattices.lattices.size();
 
 	focalLength = inpM.getK()(0,0);
 	principalPoint[0] = inpM.getK()(0,2);
@@ -43,48 +41,31 @@ BundleOptimizer::~BundleOptimizer() {
 	delete [] consolidatedLatticeModel;
 }
 
-void BundleOptimizer::initNumLattices(){
-
-	list<list<LatticeClass>>::iterator consolidatedIt;
-
-	size_t latticeCount = 0;
-	for(consolidatedIt = consolidatedLattices.begin(); consolidatedIt != consolidatedLattices.end(); ++consolidatedIt){
-		latticeCount += (*consolidatedIt).size();
-	}
-
-	num_lattices = latticeCount;
-}
-
 void BundleOptimizer::initRigidConsolidatedLatticeModel(){
 
 	rigidConsolidatedLatticeModel = new CeresLattModel[numConsolidatedLattices];
 
-	list<list<LatticeClass>>::iterator consolidatedIt;
-
-	int consolidatedGroupID = 0;
-
 	// iterate over all consolidated groups
-	for (consolidatedIt = consolidatedLattices.begin(); consolidatedIt != consolidatedLattices.end(); ++consolidatedIt){
-
-		list<LatticeClass>::iterator latticeIt;
+	for (size_t consolidatedGroupID = 0; consolidatedGroupID < numConsolidatedLattices; consolidatedGroupID++){
 
 		// iterate over all lattices in the group to find one with consolidationTransformation == 0 (for simplicity)
 
-		for(latticeIt = (*consolidatedIt).begin(); latticeIt != (*consolidatedIt).end(); latticeIt++){
+		for (int latticeID = consolidatedLattices.groupBegin(consolidatedGroupID); latticeID < consolidatedLattices.groupEnd(consolidatedGroupID); latticeID++){
+
+			LatticeClass const &lattice = consolidatedLattices.lattices[latticeID];
 
-			if ((*latticeIt).consolidationTransformation == 0){
+			if (lattice.consolidationTransformation == 0){
 
-				rigidConsolidatedLatticeModel[consolidatedGroupID].model[0] = (*latticeIt).LattStructure.basisVectors[0].x();
-				rigidConsolidatedLatticeModel[consolidatedGroupID].model[1] = (*latticeIt).LattStructure.basisVectors[0].y();
-				rigidConsolidatedLatticeModel[consolidatedGroupID].model[2] = (*latticeIt).LattStructure.basisVectors[0].z();
-				rigidConsolidatedLatticeModel[consolidatedGroupID].model[3] = (*latticeIt).LattStructure.basisVectors[1].x();
-				rigidConsolidatedLatticeModel[consolidatedGroupID].model[4] = (*latticeIt).LattStructure.basisVectors[1].y();
-				rigidConsolidatedLatticeModel[consolidatedGroupID].model[5] = (*latticeIt).LattStructure.basisVectors[1].z();
+				rigidConsolidatedLatticeModel[consolidatedGroupID].model[0] = lattice.LattStructure.basisVectors[0].x();
+				rigidConsolidatedLatticeModel[consolidatedGroupID].model[1] = lattice.LattStructure.basisVectors[0].y();
+				rigidConsolidatedLatticeModel[consolidatedGroupID].model[2] = lattice.LattStructure.basisVectors[0].z();
+				rigidConsolidatedLatticeModel[consolidatedGroupID].model[3] = lattice.LattStructure.basisVectors[1].x();
+				rigidConsolidatedLatticeModel[consolidatedGroupID].model[4] = lattice.LattStructure.basisVectors[1].y();
+				rigidConsolidatedLatticeModel[consolidatedGroupID].model[5] = lattice.LattStructure.basisVectors[1].z();
 
 				break;
 			}
 		}
-		consolidatedGroupID++;
 	}
 }
 
@@ -93,26 +74,16 @@ void BundleOptimizer::initConsolidatedLatticeModel(){
 
 	consolidatedLatticeModel = new CeresLattModel[num_lattices];
 
-	list<list<LatticeClass>>::iterator consolidatedIt;
-
-	int latticeID = 0;
-
-	// iterate over all consolidated groups
-	for (consolidatedIt = consolidatedLattices.begin(); consolidatedIt != consolidatedLattices.end(); ++consolidatedIt){
+	for (size_t latticeID = 0; latticeID < num_lattices; latticeID++){
 
-		list<LatticeClass>::iterator latticeIt;
+		LatticeClass const &lattice = consolidatedLattices.lattices[latticeID];
 
-		for(latticeIt = (*consolidatedIt).begin(); latticeIt != (*consolidatedIt).end(); latticeIt++){
-
-			consolidatedLatticeModel[latticeID].model[0] = (*latticeIt).LattStructure.basisVectors[0].x();
-			consolidatedLatticeModel[latticeID].model[1] = (*latticeIt).LattStructure.basisVectors[0].y();
-			consolidatedLatticeModel[latticeID].model[2] = (*latticeIt).LattStructure.basisVectors[0].z();
-			consolidatedLatticeModel[latticeID].model[3] = (*latticeIt).LattStructure.basisVectors[1].x();
-			consolidatedLatticeModel[latticeID].model[4] = (*latticeIt).LattStructure.basisVectors[1].y();
-			consolidatedLatticeModel[latticeID].model[5] = (*latticeIt).LattStructure.basisVectors[1].z();
-
-			latticeID++;
-		}
+		consolidatedLatticeModel[latticeID].model[0] = lattice.LattStructure.basisVectors[0].x();
+		consolidatedLatticeModel[latticeID].model[1] = lattice.LattStructure.basisVectors[0].y();
+		consolidatedLatticeModel[latticeID].model[2] = lattice.LattStructure.basisVectors[0].z();
+		consolidatedLatticeModel[latticeID].model[3] = lattice.LattStructure.basisVectors[1].x();
+		consolidatedLatticeModel[latticeID].model[4] = lattice.LattStructure.basisVectors[1].y();
+		consolidatedLatticeModel[latticeID].model[5] = lattice.LattStructure.basisVectors[1].z();
 	}
 }
 
@@ -136,7 +107,7 @@ void BundleOptimizer::addPointReprojectionResiduals() {
 	//create a residual term for each observation of each 3D point of each lattice. ( sum_L{sum_p3D{sum_2dobs{}}} )
 
 	for (int p3d = 0; p3d < (*allPoints).size(); p3d++){
-		TriangulatedPoint Tp = (*allPoints)[p3d];
+		TriangulatedPoint const &Tp = (*allPoints)[p3d];
 
 		for (size_t view_id = 0; view_id < Tp.measurements.size(); view_id++ ){ //iteration over image observations of this 3d point
 
@@ -178,23 +149,20 @@ void BundleOptimizer::addRigidGridTransformationResiduals(double rigidGridTransf
 
 	//create a residual term for each observation of each pair of 3D point on every lattice.
 
-	list<list<LatticeClass> >::iterator consolidatedIt;
-	list<LatticeClass>::iterator latticeIt;
-
-	int consolidatedGroupID = 0;
+	for (size_t consolidatedGroupID = 0; consolidatedGroupID < numConsolidatedLattices; consolidatedGroupID++){
 
-	for(consolidatedIt = consolidatedLattices.begin(); consolidatedIt != consolidatedLattices.end(); ++consolidatedIt){
+		for (int latticeID = consolidatedLattices.groupBegin(consolidatedGroupID); latticeID < consolidatedLattices.groupEnd(consolidatedGroupID); latticeID++){
 
-		for(latticeIt = (*consolidatedIt).begin(); latticeIt != (*consolidatedIt).end(); ++latticeIt){
+			LatticeClass const &lattice = consolidatedLattices.lattices[latticeID];
 
-			int numLatticeGridPoints = (*latticeIt).latticeGridIndices.size();
+			int numLatticeGridPoints = lattice.latticeGridIndices.size();
 			//iterate over all pairs of 3d points: Tp,Tp2
 
 			for (size_t p3d_id=0; p3d_id < numLatticeGridPoints; p3d_id++){ //iteration over 3d points in that lattice
 
-				TriangulatedPoint Tp = (*allPoints)[(*latticeIt).latticeGridIndices[p3d_id].first];
-				int a1 = (*latticeIt).latticeGridIndices[p3d_id].second[0];
-				int a2 = (*latticeIt).latticeGridIndices[p3d_id].second[1];
+				TriangulatedPoint const &Tp = (*allPoints)[lattice.latticeGridIndices[p3d_id].pointId];
+				int a1 = lattice.latticeGridIndices[p3d_id].i;
+				int a2 = lattice.latticeGridIndices[p3d_id].j;
 
 				for (size_t p3d_id2=0; p3d_id2 < numLatticeGridPoints; p3d_id2++){ //iteration over 3d points in that lattice
 
@@ -202,15 +170,15 @@ void BundleOptimizer::addRigidGridTransformationResiduals(double rigidGridTransf
 						continue;
 					}
 
-					TriangulatedPoint Tp2 = (*allPoints)[(*latticeIt).latticeGridIndices[p3d_id2].first];
-					int b1 = (*latticeIt).latticeGridIndices[p3d_id2].second[0];
-					int b2 = (*latticeIt).latticeGridIndices[p3d_id2].second[1];
+					TriangulatedPoint const &Tp2 = (*allPoints)[lattice.latticeGridIndices[p3d_id2].pointId];
+					int b1 = lattice.latticeGridIndices[p3d_id2].i;
+					int b2 = lattice.latticeGridIndices[p3d_id2].j;
 
 					// Incorporate proper basis vector transformation
 
 					int swap;
 
-					switch((*latticeIt).consolidationTransformation){
+					switch(lattice.consolidationTransformation){
 
 						case 1: a1 = -a1;
 								b1 = -b1;
@@ -302,14 +270,13 @@ void BundleOptimizer::addRigidGridTransformationResiduals(double rigidGridTransf
 								   loss_function, //if NULL then squared loss
 								   CameraModel[cam_id].model,
 								   rigidConsolidatedLatticeModel[consolidatedGroupID].model,
-								   (*allPoints)[(*latticeIt).latticeGridIndices[p3d_id].first].pos.data());
+								   (*allPoints)[lattice.latticeGridIndices[p3d_id].pointId].pos.data());
 
 						gridTransformationResiduals.push_back(residualID);
 					}
 				}
 			}
 		}
-		consolidatedGroupID++;
 	}
 }
 
@@ -320,37 +287,21 @@ void BundleOptimizer::addGridTransformationAndBasisVectorResiduals(double gridTr
 
 	ceres::CostFunction* cost_function;
 
-	list<list<LatticeClass> >::iterator consolidatedIt;
-	list<LatticeClass>::iterator latticeIt, latticeIt1, latticeIt2;
+	for (size_t consolidatedGroupID = 0; consolidatedGroupID < numConsolidatedLattices; consolidatedGroupID++){
 
-	int consolidatedGroupID = 0;
-	int latticeID = 0;
-
-	for(consolidatedIt = consolidatedLattices.begin(); consolidatedIt != consolidatedLattices.end(); ++consolidatedIt){
+		int groupBegin = consolidatedLattices.groupBegin(consolidatedGroupID);
+		int groupEnd = consolidatedLattices.groupEnd(consolidatedGroupID);
 
 		// Add penalty functions for differences of corresponding basis vectors between every lattice pair in a consolidated group
 
-		// copy the ID of the first lattice in the consolidated group
-		int lattice1ID = latticeID;
-
 		// Iterate over all lattices in the consolidated group
-		for(latticeIt1 = (*consolidatedIt).begin(); latticeIt1 != (*consolidatedIt).end(); ++latticeIt1){
-
-			LatticeClass lattice1 = (*latticeIt1);
-
-			// copy and increase the ID of the current lattice by one
-			int lattice2ID = lattice1ID+1;
-
-			latticeIt2 = list<LatticeClass>::iterator(latticeIt1);
-			latticeIt2++;
+		for (int lattice1ID = groupBegin; lattice1ID < groupEnd; lattice1ID++){
 
 			// Iterate over all lattices with higher index in the consolidated group
-			for(; latticeIt2 != (*consolidatedIt).end(); ++latticeIt2){
+			for (int lattice2ID = lattice1ID+1; lattice2ID < groupEnd; lattice2ID++){
 
-				LatticeClass lattice2 = (*latticeIt2);
-
-				int cTransformation1 = (*latticeIt1).consolidationTransformation;
-				int cTransformation2 = (*latticeIt2).consolidationTransformation;
+				int cTransformation1 = consolidatedLattices.lattices[lattice1ID].consolidationTransformation;
+				int cTransformation2 = consolidatedLattices.lattices[lattice2ID].consolidationTransformation;
 
 				//add cost function (lattice1, lattice2) for basis vector 0
 				cost_function = VectorDifferenceError::Create(cTransformation1, cTransformation2, true);
@@ -371,24 +322,23 @@ void BundleOptimizer::addGridTransformationAndBasisVectorResiduals(double gridTr
 										consolidatedLatticeModel[lattice2ID].model);
 
 				basisVectorResiduals.push_back(residualID);
-
-				lattice2ID++;
 			}
-			lattice1ID++;
 		}
 
 		// Create a residual term for each observation of each pair of 3D points on the lattice.
 
-		for(latticeIt = (*consolidatedIt).begin(); latticeIt != (*consolidatedIt).end(); ++latticeIt){
+		for (int latticeID = groupBegin; latticeID < groupEnd; latticeID++){
 
-			int numLatticeGridPoints = (*latticeIt).latticeGridIndices.size();
+			LatticeClass const &lattice = consolidatedLattices.lattices[latticeID];
+
+			int numLatticeGridPoints = lattice.latticeGridIndices.size();
 			//iterate over all pairs of 3d points: Tp,Tp2
 
 			for (size_t p3d_id=0; p3d_id < numLatticeGridPoints; p3d_id++){ //iteration over 3d points in that lattice
 
-				TriangulatedPoint Tp = (*allPoints)[(*latticeIt).latticeGridIndices[p3d_id].first];
-				int a1 = (*latticeIt).latticeGridIndices[p3d_id].second[0];
-				int a2 = (*latticeIt).latticeGridIndices[p3d_id].second[1];
+				TriangulatedPoint const &Tp = (*allPoints)[lattice.latticeGridIndices[p3d_id].pointId];
+				int a1 = lattice.latticeGridIndices[p3d_id].i;
+				int a2 = lattice.latticeGridIndices[p3d_id].j;
 
 
 				for (size_t p3d_id2=0; p3d_id2 < numLatticeGridPoints; p3d_id2++){ //iteration over 3d points in that lattice
@@ -397,9 +347,9 @@ void BundleOptimizer::addGridTransformationAndBasisVectorResiduals(double gridTr
 						continue;
 					}
 
-					TriangulatedPoint Tp2 = (*allPoints)[(*latticeIt).latticeGridIndices[p3d_id2].first];
-					int b1 = (*latticeIt).latticeGridIndices[p3d_id2].second[0];
-					int b2 = (*latticeIt).latticeGridIndices[p3d_id2].second[1];
+					TriangulatedPoint const &Tp2 = (*allPoints)[lattice.latticeGridIndices[p3d_id2].pointId];
+					int b1 = lattice.latticeGridIndices[p3d_id2].i;
+					int b2 = lattice.latticeGridIndices[p3d_id2].j;
 
 					for (size_t view_id = 0; view_id < Tp2.measurements.size(); view_id++ ){ //iteration over image observations of this 3d point
 
@@ -433,15 +383,13 @@ void BundleOptimizer::addGridTransformationAndBasisVectorResiduals(double gridTr
 								   loss_function,
 								   CameraModel[cam_id].model,
 								   consolidatedLatticeModel[latticeID].model,
-								   (*allPoints)[(*latticeIt).latticeGridIndices[p3d_id].first].pos.data());
+								   (*allPoints)[lattice.latticeGridIndices[p3d_id].pointId].pos.data());
 
 						gridTransformationResiduals.push_back(residualID);
 					}
 				}
 			}
-			latticeID++;
 		}
-		consolidatedGroupID++;
 	}
 }
 
@@ -516,125 +464,111 @@ vector< Eigen::Matrix<double,3,4> > BundleOptimizer::getOptimizedCameras(){
 	return camPoses;
 }
 
-void BundleOptimizer::readoutLatticeParameters(list<list<LatticeClass> > &aConsolidatedLattices){
-
-	list<list<LatticeClass>>::iterator consolidatedIt;
+void BundleOptimizer::readoutLatticeParameters(){
 
-	int latticeID = 0;
+	for (size_t latticeID = 0; latticeID < num_lattices; latticeID++){
 
-	// iterate over all consolidated groups
-	for (consolidatedIt = aConsolidatedLattices.begin(); consolidatedIt != aConsolidatedLattices.end(); ++consolidatedIt){
-
-		list<LatticeClass>::iterator latticeIt;
-
-		for(latticeIt = (*consolidatedIt).begin(); latticeIt != (*consolidatedIt).end(); latticeIt++){
+		LatticeClass &lattice = consolidatedLattices.lattices[latticeID];
 
-			(*latticeIt).LattStructure.basisVectors[0].x() = consolidatedLatticeModel[latticeID].model[0];
-			(*latticeIt).LattStructure.basisVectors[0].y() = consolidatedLatticeModel[latticeID].model[1];
-			(*latticeIt).LattStructure.basisVectors[0].z() = consolidatedLatticeModel[latticeID].model[2];
-			(*latticeIt).LattStructure.basisVectors[1].x() = consolidatedLatticeModel[latticeID].model[3];
-			(*latticeIt).LattStructure.basisVectors[1].y() = consolidatedLatticeModel[latticeID].model[4];
-			(*latticeIt).LattStructure.basisVectors[1].z() = consolidatedLatticeModel[latticeID].model[5];
+		lattice.LattStructure.basisVectors[0].x() = consolidatedLatticeModel[latticeID].model[0];
+		lattice.LattStructure.basisVectors[0].y() = consolidatedLatticeModel[latticeID].model[1];
+		lattice.LattStructure.basisVectors[0].z() = consolidatedLatticeModel[latticeID].model[2];
+		lattice.LattStructure.basisVectors[1].x() = consolidatedLatticeModel[latticeID].model[3];
+		lattice.LattStructure.basisVectors[1].y() = consolidatedLatticeModel[latticeID].model[4];
+		lattice.LattStructure.basisVectors[1].z() = consolidatedLatticeModel[latticeID].model[5];
 
-			// adjust corner
-			int a1 = (*latticeIt).latticeGridIndices[0].second[0];
-			int a2 = (*latticeIt).latticeGridIndices[0].second[1];
-
-			(*latticeIt).LattStructure.corner = (*allPoints)[(*latticeIt).latticeGridIndices[0].first].pos -
-						a1*(*latticeIt).LattStructure.basisVectors[0] - a2*(*latticeIt).LattStructure.basisVectors[1];
+		// adjust corner
+		int a1 = lattice.latticeGridIndices[0].i;
+		int a2 = lattice.latticeGridIndices[0].j;
 
-			latticeID++;
-		}
+		lattice.LattStructure.corner = (*allPoints)[lattice.latticeGridIndices[0].pointId].pos -
+					a1*lattice.LattStructure.basisVectors[0] - a2*lattice.LattStructure.basisVectors[1];
 	}
 }
 
-void BundleOptimizer::readoutRigidLatticeParameters(list<list<LatticeClass> > &aConsolidatedLattices){
-
-	int consolidationGroupID = 0;
+void BundleOptimizer::readoutRigidLatticeParameters(){
 
-	list<list<LatticeClass>>::iterator consolidatedIt;
+	for (size_t consolidationGroupID = 0; consolidationGroupID < numConsolidatedLattices; consolidationGroupID++){
 
-	for (consolidatedIt = aConsolidatedLattices.begin(); consolidatedIt != aConsolidatedLattices.end(); ++consolidatedIt){
+		for (int latticeID = consolidatedLattices.groupBegin(consolidationGroupID); latticeID < consolidatedLattices.groupEnd(consolidationGroupID); latticeID++){
 
-		list<LatticeClass>::iterator latticeIt;
-
-		for (latticeIt = (*consolidatedIt).begin(); latticeIt != (*consolidatedIt).end(); ++latticeIt){
+			LatticeClass &lattice = consolidatedLattices.lattices[latticeID];
 
 			// write back the basis vectors with respect to the proper transformation
 
-			switch((*latticeIt).consolidationTransformation){
+			switch(lattice.consolidationTransformation){
 
 			case 0:
 
-				(*latticeIt).LattStructure.basisVectors[0][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
-				(*latticeIt).LattStructure.basisVectors[0][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
-				(*latticeIt).LattStructure.basisVectors[0][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[2];
-				(*latticeIt).LattStructure.basisVectors[1][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
-				(*latticeIt).LattStructure.basisVectors[1][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
-				(*latticeIt).LattStructure.basisVectors[1][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[5]; break;
+				lattice.LattStructure.basisVectors[0][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
+				lattice.LattStructure.basisVectors[0][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
+				lattice.LattStructure.basisVectors[0][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[2];
+				lattice.LattStructure.basisVectors[1][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
+				lattice.LattStructure.basisVectors[1][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
+				lattice.LattStructure.basisVectors[1][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[5]; break;
 
 			case 1:
 
-				(*latticeIt).LattStructure.basisVectors[0][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
-				(*latticeIt).LattStructure.basisVectors[0][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
-				(*latticeIt).LattStructure.basisVectors[0][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[2];
-				(*latticeIt).LattStructure.basisVectors[1][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
-				(*latticeIt).LattStructure.basisVectors[1][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
-				(*latticeIt).LattStructure.basisVectors[1][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[5]; break;
+				lattice.LattStructure.basisVectors[0][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
+				lattice.LattStructure.basisVectors[0][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
+				lattice.LattStructure.basisVectors[0][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[2];
+				lattice.LattStructure.basisVectors[1][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
+				lattice.LattStructure.basisVectors[1][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
+				lattice.LattStructure.basisVectors[1][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[5]; break;
 
 			case 2:
 
-				(*latticeIt).LattStructure.basisVectors[0][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
-				(*latticeIt).LattStructure.basisVectors[0][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
-				(*latticeIt).LattStructure.basisVectors[0][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[2];
-				(*latticeIt).LattStructure.basisVectors[1][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
-				(*latticeIt).LattStructure.basisVectors[1][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
-				(*latticeIt).LattStructure.basisVectors[1][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[5]; break;
+				lattice.LattStructure.basisVectors[0][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
+				lattice.LattStructure.basisVectors[0][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
+				lattice.LattStructure.basisVectors[0][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[2];
+				lattice.LattStructure.basisVectors[1][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
+				lattice.LattStructure.basisVectors[1][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
+				lattice.LattStructure.basisVectors[1][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[5]; break;
 
 			case 3:
 
-				(*latticeIt).LattStructure.basisVectors[0][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
-				(*latticeIt).LattStructure.basisVectors[0][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
-				(*latticeIt).LattStructure.basisVectors[0][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[2];
-				(*latticeIt).LattStructure.basisVectors[1][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
-				(*latticeIt).LattStructure.basisVectors[1][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
-				(*latticeIt).LattStructure.basisVectors[1][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[5]; break;
+				lattice.LattStructure.basisVectors[0][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
+				lattice.LattStructure.basisVectors[0][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
+				lattice.LattStructure.basisVectors[0][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[2];
+				lattice.LattStructure.basisVectors[1][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
+				lattice.LattStructure.basisVectors[1][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
+				lattice.LattStructure.basisVectors[1][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[5]; break;
 
 			case 4:
 
-				(*latticeIt).LattStructure.basisVectors[0][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
-				(*latticeIt).LattStructure.basisVectors[0][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
-				(*latticeIt).LattStructure.basisVectors[0][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[5];
-				(*latticeIt).LattStructure.basisVectors[1][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
-				(*latticeIt).LattStructure.basisVectors[1][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
-				(*latticeIt).LattStructure.basisVectors[1][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[2]; break;
+				lattice.LattStructure.basisVectors[0][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
+				lattice.LattStructure.basisVectors[0][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
+				lattice.LattStructure.basisVectors[0][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[5];
+				lattice.LattStructure.basisVectors[1][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
+				lattice.LattStructure.basisVectors[1][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
+				lattice.LattStructure.basisVectors[1][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[2]; break;
 
 			case 5:
 
-				(*latticeIt).LattStructure.basisVectors[0][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
-				(*latticeIt).LattStructure.basisVectors[0][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
-				(*latticeIt).LattStructure.basisVectors[0][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[5];
-				(*latticeIt).LattStructure.basisVectors[1][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
-				(*latticeIt).LattStructure.basisVectors[1][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
-				(*latticeIt).LattStructure.basisVectors[1][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[2]; break;
+				lattice.LattStructure.basisVectors[0][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
+				lattice.LattStructure.basisVectors[0][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
+				lattice.LattStructure.basisVectors[0][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[5];
+				lattice.LattStructure.basisVectors[1][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
+				lattice.LattStructure.basisVectors[1][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
+				lattice.LattStructure.basisVectors[1][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[2]; break;
 
 			case 6:
 
-				(*latticeIt).LattStructure.basisVectors[0][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
-				(*latticeIt).LattStructure.basisVectors[0][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
-				(*latticeIt).LattStructure.basisVectors[0][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[5];
-				(*latticeIt).LattStructure.basisVectors[1][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
-				(*latticeIt).LattStructure.basisVectors[1][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
-				(*latticeIt).LattStructure.basisVectors[1][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[2]; break;
+				lattice.LattStructure.basisVectors[0][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
+				lattice.LattStructure.basisVectors[0][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
+				lattice.LattStructure.basisVectors[0][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[5];
+				lattice.LattStructure.basisVectors[1][0] = rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
+				lattice.LattStructure.basisVectors[1][1] = rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
+				lattice.LattStructure.basisVectors[1][2] = rigidConsolidatedLatticeModel[consolidationGroupID].model[2]; break;
 
 			case 7:
 
-				(*latticeIt).LattStructure.basisVectors[0][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
-				(*latticeIt).LattStructure.basisVectors[0][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
-				(*latticeIt).LattStructure.basisVectors[0][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[5];
-				(*latticeIt).LattStructure.basisVectors[1][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
-				(*latticeIt).LattStructure.basisVectors[1][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
-				(*latticeIt).LattStructure.basisVectors[1][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[2]; break;
+				lattice.LattStructure.basisVectors[0][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[3];
+				lattice.LattStructure.basisVectors[0][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[4];
+				lattice.LattStructure.basisVectors[0][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[5];
+				lattice.LattStructure.basisVectors[1][0] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[0];
+				lattice.LattStructure.basisVectors[1][1] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[1];
+				lattice.LattStructure.basisVectors[1][2] = - rigidConsolidatedLatticeModel[consolidationGroupID].model[2]; break;
 
 			default: break;
 
@@ -642,14 +576,12 @@ void BundleOptimizer::readoutRigidLatticeParameters(list<list<LatticeClass> > &a
 
 		// adjust corner
 
-		int a1 = (*latticeIt).latticeGridIndices[0].second[0];
-		int a2 = (*latticeIt).latticeGridIndices[0].second[1];
-		(*latticeIt).LattStructure.corner = (*allPoints)[(*latticeIt).latticeGridIndices[0].first].pos -
-				a1*(*latticeIt).LattStructure.basisVectors[0] - a2*(*latticeIt).LattStructure.basisVectors[1];
+		int a1 = lattice.latticeGridIndices[0].i;
+		int a2 = lattice.latticeGridIndices[0].j;
+		lattice.LattStructure.corner = (*allPoints)[lattice.latticeGridIndices[0].pointId].pos -
+				a1*lattice.LattStructure.basisVectors[0] - a2*lattice.LattStructure.basisVectors[1];
 
 		}
-
-		consolidationGroupID++;
 	}
 }
 
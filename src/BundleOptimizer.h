@@ -48,7 +48,7 @@ private:
 		bool robust = true;
 	};
 
-	list<list<LatticeClass>> consolidatedLattices; 	/*!< List of consolidated lattices */
+	ConsolidatedLattices &consolidatedLattices; 	/*!< The consolidated lattices, shared with the caller. Lattice and group ids are their flat indices. */
 	vector<TriangulatedPoint>* allPoints;
 	vector<int> camViewIndices; //mapping from camera pose index to image
 
@@ -70,11 +70,6 @@ private:
 	ceres::Problem problem;
 	FLAGS FLAGS;
 
-	/*!
-	 * Initializes num_lattices.
-	 */
-	void initNumLattices();
-
 	/*!
 	 * Initializes consolidatedLatticeModel.
 	 */
@@ -115,10 +110,11 @@ public:
 	/*!
 	 * Constructor
 	 *
-	 * @param[in] aConsolidatedLattices	A list of lattice consolidation groups
+	 * @param[in] aConsolidatedLattices	The lattice consolidation groups (see LatticeClass::consolidateLattices). They are referenced, not copied,
+	 * 									and must outlive the optimizer.
 	 * @param[in] inpM					A pointer to the input manager that was already used to find the lattice consolidation groups
 	 */
-	BundleOptimizer(list<list<LatticeClass> > &aConsolidatedLattices, inputManager &inpM);
+	BundleOptimizer(ConsolidatedLattices &aConsolidatedLattices, inputManager &inpM);
 
 	/*
 	 * Destructor
@@ -154,21 +150,17 @@ public:
 
 	/*!
 	 * Reads out the optimized lattice parameters (basisvectors and the correspondingly updated corner) and writes their new values to
-	 * the specified consolidated lattices list. Use this method only if the BundleOptimizer was set up with setupConsolidatedLatticeOptimizer,
+	 * the consolidated lattices given to the constructor. Use this method only if the BundleOptimizer was set up with setupConsolidatedLatticeOptimizer,
 	 * otherwise the behavior is undefined.
-	 *
-	 * @param[in,out] aConsolidatedLattices	The consolidatedLattices object that was already given when initializing the BundleOptimizer.
 	 */
-	void readoutLatticeParameters(list<list<LatticeClass> > &aConsolidatedLattices);
+	void readoutLatticeParameters();
 
 	/*!
 	 * Reads out the optimized lattice parameters (basisvectors and the correspondingly updated corner) and writes their new values to
-	 * the specified consolidated lattices list. Use this method only if the BundleOptimizer was set up with setupRigidConsolidatedLatticeOptimizer,
+	 * the consolidated lattices given to the constructor. Use this method only if the BundleOptimizer was set up with setupRigidConsolidatedLatticeOptimizer,
 	 * otherwise the behavios is undefined.
-	 *
-	 * @param[in,out] aConsolidatedLattices	The consolidatedLattices object that was already given when initializing the BundleOptimizer.
 	 */
-	void readoutRigidLatticeParameters(list<list<LatticeClass> > &aConsolidatedLattices);
+	void readoutRigidLatticeParameters();
 
 	/*!
 	 * Calculate the summed costs of a specified cost type.
@@ -0,0 +1,146 @@
+#ifndef CAMERARIG_H
+#define CAMERARIG_H
+
+#include <vector>
+#include <map>
+#include <Eigen/Dense>
+
+#include "camera.h"
+
+using namespace Eigen;
+using namespace std;
+
+/**
+ * \class CameraRig
+ *
+ *
+ * All cameras of a dataset, set up once: for every camera its ready-to-use CameraMatrix (inverse intrinsics, rotation transpose,
+ * centre and projection already cached), its projection matrix K[R|t], its centre, its optical axis and its view, each kind in one
+ * contiguous array indexed by the camera. Hot loops index into the rig instead of building a CameraMatrix and calling setIntrinsic
+ * and setOrientation per point.
+ *
+ * A rig is immutable, it is shared read-only (see inputManager::getCameraRig) and safe to use from several threads.
+ * When the cameras change (e.g. after bundle adjustment), a new rig is built.
+ *
+ */
+class CameraRig {
+
+public:
+
+	/*! An empty rig, without cameras. */
+	CameraRig(){}
+
+	/*!
+	 * The constructor.
+	 *
+	 * @param[in] K			The intrinsic camera matrix, shared by all cameras.
+	 * @param[in] camPoses	The poses [R|t] of the cameras.
+	 * @param[in] viewIds	The image of every camera.
+	 */
+	CameraRig(Matrix3d const &K, vector<Matrix<double,3,4> > const &camPoses, vector<int> const &viewIds){
+		intrinsics = K;
+		poses = camPoses;
+		views = viewIds;
+
+		int count = camPoses.size();
+		cameras.reserve(count);
+		projections.reserve(count);
+		centers.reserve(count);
+		positions.reserve(count);
+		opticalAxes.reserve(count);
+
+		for (int c = 0; c < count; c++){
+			cameras.push_back(CameraMatrix(K, camPoses[c]));
+			projections.push_back(cameras[c].getProjection());
+			centers.push_back(cameras[c].cameraCenter());
+			positions.push_back(camPoses[c].col(3));
+			opticalAxes.push_back(cameras[c].opticalAxis());
+
+			// the first camera of a view is used, as in the searches this replaces
+			cameraOfViews.insert(make_pair(viewIds[c], c));
+		}
+	}
+
+	/*! Returns the number of cameras. */
+	int size() const{
+		return cameras.size();
+	}
+
+	/*! Returns the intrinsic camera matrix. */
+	Matrix3d const &getK() const{
+		return intrinsics;
+	}
+
+	/*! Returns the camera c, with intrinsics and orientation set. */
+	CameraMatrix const &camera(int c) const{
+		return cameras[c];
+	}
+
+	/*! Returns the pose [R|t] of camera c. */
+	Matrix<double,3,4> const &pose(int c) const{
+		return poses[c];
+	}
+
+	/*! Returns the projection matrix K[R|t] of camera c. */
+	Matrix<double,3,4> const &projection(int c) const{
+		return projections[c];
+	}
+
+	/*! Returns the centre -R^T t of camera c. */
+	Vector3d const &center(int c) const{
+		return centers[c];
+	}
+
+	/*! Returns the translation column t of camera c, the position the view selection measures the camera-point lines from. */
+	Vector3d const &position(int c) const{
+		return positions[c];
+	}
+
+	/*! Returns the optical axis of camera c, in world coordinates. */
+	Vector3d const &opticalAxis(int c) const{
+		return opticalAxes[c];
+	}
+
+	/*! Returns the view (index into the image names) of camera c. */
+	int view(int c) const{
+		return views[c];
+	}
+
+	/*! Returns the first camera of a view, -1 if the view has no camera. */
+	int cameraOfView(int view) const{
+		map<int, int>::const_iterator camera = cameraOfViews.find(view);
+		return (camera == cameraOfViews.end()) ? -1 : camera->second;
+	}
+
+	/*! Returns the camera poses, in the order of the cameras. */
+	vector<Matrix<double,3,4> > const &getCamPoses() const{
+		return poses;
+	}
+
+	/*! Returns the views of the cameras, in the order of the cameras. */
+	vector<int> const &getViewIds() const{
+		return views;
+	}
+
+private:
+
+	Matrix3d intrinsics = Matrix3d::Identity();
+
+	vector<CameraMatrix> cameras;
+
+	vector<Matrix<double,3,4> > poses;
+
+	vector<Matrix<double,3,4> > projections;
+
+	vector<Vector3d> centers;
+
+	vector<Vector3d> positions;
+
+	vector<Vector3d> opticalAxes;
+
+	vector<int> views;
+
+	map<int, int> cameraOfViews;	/*!< The first camera of every view. */
+};
+
+#endif
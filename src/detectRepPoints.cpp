@@ -337,6 +337,7 @@ int detectRepPoints::computeSiftDescriptor(int imageIndex, Eigen::Vector2f pos,
     roi = cv::Scalar(255);
 
     // show roi
+#ifndef LATT_HEADLESS
     if(showRoi)
     {
         cv::Scalar color = cv::Scalar( 100, 100, 100 );
@@ -347,6 +348,7 @@ int detectRepPoints::computeSiftDescriptor(int imageIndex, Eigen::Vector2f pos,
         cv::imshow("Region of interest",mask);
         // cv::waitKey(0);
     }
+#endif
 
     // detect sift keypoints in roi
     cv::SiftFeatureDetector detector;
@@ -376,6 +378,7 @@ int detectRepPoints::computeSiftDescriptor(int imageIndex, Eigen::Vector2f pos,
     cout << "Using keypoint size = " << KPsize << endl;
 
     // Add results to image and save.
+#ifndef LATT_HEADLESS
     if(showKeypoints)
     {
         cv::Mat output;
@@ -386,6 +389,7 @@ int detectRepPoints::computeSiftDescriptor(int imageIndex, Eigen::Vector2f pos,
         cv::imshow("ROI with keypoints",output);
         cv::waitKey(65);
     }
+#endif
 
     // compute descriptor of desired keypoint location using calculated size
     cv::SIFT siftDetector;
@@ -976,10 +980,15 @@ int detectRepPoints::visualiseGroups()
         }
 
         // show window
+#ifdef LATT_HEADLESS
+        mkdir("data/grouping", 0755);
+        cv::imwrite("data/grouping/group"+to_string(i)+".png",input);
+#else
         cv::namedWindow("Visualisation of external group",cv::WINDOW_NORMAL);
         cv::imshow("Visualisation of external group",input);
         cout << "Press key to continue... "<< endl;
         cv::waitKey();
+#endif
     }
 
     return 0;
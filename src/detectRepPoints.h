@@ -12,6 +12,7 @@
 #include <Eigen/Dense>
 #include <vector>
 #include <fstream>
+#include <sys/stat.h>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/core/core.hpp>
 #include <opencv2/nonfree/features2d.hpp> //Thanks to Alessandro
@@ -0,0 +1,296 @@
+#include "facadeRectifier.h"
+
+#include <math.h>
+#include "3dtools.h"
+
+constexpr double FacadeRectifier::TEXTURE_MARGIN;
+
+
+FacadeRectifier::FacadeRectifier(vector<Vector3d> const &aPoints, Vector4d const &aPlane, inputManager* aInputManager){
+
+	inpManager = aInputManager;
+	plane = aPlane;
+
+	Vector3d centroid = Vector3d(0,0,0);
+	for (size_t i = 0; i < aPoints.size(); i++){
+		centroid = centroid + aPoints[i];
+	}
+	if (aPoints.size() > 0){
+		centroid = centroid / aPoints.size();
+	}
+
+	frame = PlaneFrame(plane, centroid);
+
+	// bounding box of the points in plane coordinates
+	Vector2d minCorner = Vector2d(0,0);
+	Vector2d maxCorner = Vector2d(0,0);
+	if (aPoints.size() > 0){
+		minCorner = frame.toPlane(aPoints[0]);
+		maxCorner = minCorner;
+	}
+	for (size_t i = 0; i < aPoints.size(); i++){
+		Vector2d coordinates = frame.toPlane(aPoints[i]);
+		minCorner = minCorner.cwiseMin(coordinates);
+		maxCorner = maxCorner.cwiseMax(coordinates);
+	}
+
+	Vector2d margin = (maxCorner - minCorner)*TEXTURE_MARGIN;
+	minCorner = minCorner - margin;
+	maxCorner = maxCorner + margin;
+
+	// keep the texture size bounded, large planes get larger pixels
+	pixelSize = PIXEL_SIZE;
+	double extent = (maxCorner - minCorner).maxCoeff();
+	if (extent / pixelSize > MAX_TEXTURE_SIZE - 1){
+		pixelSize = extent / (MAX_TEXTURE_SIZE - 1);
+	}
+
+	textureOrigin = minCorner;
+
+	int width = (int)ceil((maxCorner(0) - minCorner(0)) / pixelSize) + 1;
+	int height = (int)ceil((maxCorner(1) - minCorner(1)) / pixelSize) + 1;
+
+	texture = cv::Mat(height, width, CV_32FC1, cv::Scalar(0));
+	coverage = cv::Mat(height, width, CV_8UC1, cv::Scalar(0));
+
+	rectify();
+	computeIntegralImages();
+}
+
+void FacadeRectifier::rectify(){
+
+	shared_ptr<CameraRig const> rig = inpManager->getCameraRig();
+	vector<string> imageNames = inpManager->getImgNames();
+
+	// texture pixel (x,y,1) -> plane coordinates (a,b,1)
+	Matrix3d textureToPlane = Matrix3d::Identity();
+	textureToPlane(0,0) = pixelSize;
+	textureToPlane(1,1) = pixelSize;
+	textureToPlane(0,2) = textureOrigin(0);
+	textureToPlane(1,2) = textureOrigin(1);
+
+	vector<Matrix3d> homographies;
+	vector<Vector3d> centers;
+	vector<cv::Mat> images;
+
+	//TODO: pose selection only for the three images that the lattices were extracted (as in compareSiftFronto).
+	for (int i = 0; i < rig->size(); i++){
+
+		int view = rig->view(i);
+
+		if ((view < 45) || (view > 47))
+		{
+			continue;
+		}
+
+		cv::Mat image = loadGrayscaleImage(imageNames[view]);
+		if (!image.data){
+			continue;
+		}
+
+		Matrix<double,3,4> const &P = rig->projection(i);
+
+		// plane-induced homography: plane coordinates (a,b,1) -> image pixels
+		Matrix3d planeToImage;
+		planeToImage.col(0) = P.leftCols<3>()*frame.axisU;
+		planeToImage.col(1) = P.leftCols<3>()*frame.axisV;
+		planeToImage.col(2) = P.leftCols<3>()*frame.origin + P.col(3);
+
+		homographies.push_back(planeToImage*textureToPlane);
+		centers.push_back(rig->center(i));
+		images.push_back(image);
+	}
+
+	for (int y = 0; y < texture.rows; y++){
+
+		float* textureRow = texture.ptr<float>(y);
+		unsigned char* coverageRow = coverage.ptr<unsigned char>(y);
+
+		for (int x = 0; x < texture.cols; x++){
+
+			Vector3d point = frame.fromPlane(textureOrigin + Vector2d(x,y)*pixelSize);
+
+			double cosangle = 0;
+			int bestview = -1;
+			Vector2d pbest;
+
+			for (size_t v = 0; v < homographies.size(); v++){
+
+				Vector3d q = homographies[v]*Vector3d(x,y,1);
+
+				// the last row of K is (0,0,1), so q(2) is the depth
+				if (q(2) <= 0){
+					continue;
+				}
+
+				Vector2d p(q(0)/q(2), q(1)/q(2));
+				if ((p[0] < 0) || (p[1] < 0) || (p[0] >= images[v].cols - 1) || (p[1] >= images[v].rows - 1)){
+					continue;
+				}
+
+				// check angle between camera-point line and plane normal, abs because we dont know the plane orientation
+				Vector3d line = point - centers[v];
+				double tmpcosangle = abs(line.dot(frame.normal))/line.norm();
+
+				if (tmpcosangle > cosangle){
+					cosangle = tmpcosangle;
+					bestview = v;
+					pbest = p;
+				}
+			}
+
+			if (bestview == -1){
+				continue;
+			}
+
+			// bilinear interpolation in the selected view
+			cv::Mat const &image = images[bestview];
+			int x0 = (int)pbest[0];
+			int y0 = (int)pbest[1];
+			double fx = pbest[0] - x0;
+			double fy = pbest[1] - y0;
+
+			const unsigned char* row0 = image.ptr<unsigned char>(y0);
+			const unsigned char* row1 = image.ptr<unsigned char>(y0+1);
+
+			textureRow[x] = (1-fy)*((1-fx)*row0[x0] + fx*row0[x0+1]) + fy*((1-fx)*row1[x0] + fx*row1[x0+1]);
+			coverageRow[x] = 255;
+		}
+	}
+}
+
+void FacadeRectifier::computeIntegralImages(){
+
+	int width = texture.cols;
+	int height = texture.rows;
+	int stride = width+1;
+
+	integral = vector<double>(stride*(height+1), 0);
+	integralSquared = vector<double>(stride*(height+1), 0);
+	integralCoverage = vector<int>(stride*(height+1), 0);
+
+	for (int y = 0; y < height; y++){
+
+		const float* textureRow = texture.ptr<float>(y);
+		const unsigned char* coverageRow = coverage.ptr<unsigned char>(y);
+
+		double rowSum = 0;
+		double rowSumSquared = 0;
+		int rowCoverage = 0;
+
+		for (int x = 0; x < width; x++){
+			rowSum += textureRow[x];
+			rowSumSquared += textureRow[x]*textureRow[x];
+			rowCoverage += (coverageRow[x] > 0);
+
+			integral[(y+1)*stride + x+1] = integral[y*stride + x+1] + rowSum;
+			integralSquared[(y+1)*stride + x+1] = integralSquared[y*stride + x+1] + rowSumSquared;
+			integralCoverage[(y+1)*stride + x+1] = integralCoverage[y*stride + x+1] + rowCoverage;
+		}
+	}
+}
+
+template <typename T>
+T FacadeRectifier::patchSum(vector<T> const &integralImage, int x, int y) const{
+
+	int stride = texture.cols+1;
+
+	int x0 = x - PATCH_RADIUS;
+	int y0 = y - PATCH_RADIUS;
+	int x1 = x + PATCH_RADIUS + 1;
+	int y1 = y + PATCH_RADIUS + 1;
+
+	return integralImage[y1*stride + x1] - integralImage[y0*stride + x1] - integralImage[y1*stride + x0] + integralImage[y0*stride + x0];
+}
+
+bool FacadeRectifier::patchIsCovered(int x, int y) const{
+
+	if ((x < PATCH_RADIUS) || (y < PATCH_RADIUS) || (x >= texture.cols - PATCH_RADIUS) || (y >= texture.rows - PATCH_RADIUS)){
+		return false;
+	}
+
+	int patchSize = (2*PATCH_RADIUS+1)*(2*PATCH_RADIUS+1);
+
+	return patchSum(integralCoverage, x, y) == patchSize;
+}
+
+double FacadeRectifier::normalizedCrossCorrelation(int x1, int y1, int x2, int y2) const{
+
+	if (!patchIsCovered(x1, y1) || !patchIsCovered(x2, y2)){
+		return -1;
+	}
+
+	double n = (2*PATCH_RADIUS+1)*(2*PATCH_RADIUS+1);
+
+	// means and variances from the integral images, only the cross term needs the patches themselves
+	double sum1 = patchSum(integral, x1, y1);
+	double sum2 = patchSum(integral, x2, y2);
+	double variance1 = patchSum(integralSquared, x1, y1) - sum1*sum1/n;
+	double variance2 = patchSum(integralSquared, x2, y2) - sum2*sum2/n;
+
+	if ((variance1 <= 1e-6) || (variance2 <= 1e-6)){
+		return -1;
+	}
+
+	double crossSum = 0;
+	for (int dy = -PATCH_RADIUS; dy <= PATCH_RADIUS; dy++){
+		const float* row1 = texture.ptr<float>(y1+dy);
+		const float* row2 = texture.ptr<float>(y2+dy);
+		for (int dx = -PATCH_RADIUS; dx <= PATCH_RADIUS; dx++){
+			crossSum += row1[x1+dx]*row2[x2+dx];
+		}
+	}
+
+	return (crossSum - sum1*sum2/n) / sqrt(variance1*variance2);
+}
+
+vector<bool> FacadeRectifier::arePointsSimilar(Vector3d const &referencePoint, vector<Vector3d> const &pointsToTest) const{
+
+	vector<bool> similar(pointsToTest.size(), false);
+
+	Vector2d referencePixel = pointToTexture(referencePoint);
+	int xr = (int)floor(referencePixel(0) + 0.5);
+	int yr = (int)floor(referencePixel(1) + 0.5);
+
+	if (!patchIsCovered(xr, yr)){
+		return similar;
+	}
+
+	for (size_t i = 0; i < pointsToTest.size(); i++){
+		Vector2d pixel = pointToTexture(pointsToTest[i]);
+		int x = (int)floor(pixel(0) + 0.5);
+		int y = (int)floor(pixel(1) + 0.5);
+
+		similar[i] = normalizedCrossCorrelation(xr, yr, x, y) >= NCC_TRESHOLD;
+	}
+
+	return similar;
+}
+
+Vector2d FacadeRectifier::pointToTexture(Vector3d const &point) const{
+	return (frame.toPlane(point) - textureOrigin) / pixelSize;
+}
+
+bool FacadeRectifier::hasTexture() const{
+	return integralCoverage.back() > 0;
+}
+
+cv::Mat const &FacadeRectifier::getTexture() const{
+	return texture;
+}
+
+cv::Mat const &FacadeRectifier::getCoverage() const{
+	return coverage;
+}
+
+PlaneFrame const &FacadeRectifier::getFrame() const{
+	return frame;
+}
+
+Vector2d FacadeRectifier::getTextureOrigin() const{
+	return textureOrigin;
+}
+
+double FacadeRectifier::getPixelSize() const{
+	return pixelSize;
+}
@@ -0,0 +1,141 @@
+#ifndef FACADERECTIFIER_H
+#define FACADERECTIFIER_H
+
+#include <vector>
+#include <Eigen/Dense>
+#include <opencv2/core/core.hpp>
+
+#include "inputManager.h"
+#include "planeFrame.h"
+
+using namespace Eigen;
+using namespace std;
+
+/**
+ * \class FacadeRectifier
+ *
+ *
+ * This class warps the views of a plane into a metric, fronto-parallel texture of the plane (the "rectified facade").
+ * Every texture pixel covers the same square area of the plane, and is taken from the most frontoparallel view that sees it,
+ * through the plane-induced homography of that view. The texture is computed once, afterwards the appearance of points on the
+ * plane can be compared by direct indexing into the texture, with normalized cross correlation (NCC) of square patches.
+ *
+ */
+class FacadeRectifier {
+
+public:
+
+	/*!
+	 * The constructor. Loads the considered views and computes the rectified texture.
+	 *
+	 * @param[in] aPoints		Points on the plane. The texture covers their bounding box in the plane, enlarged by TEXTURE_MARGIN on every side.
+	 * @param[in] aPlane		The plane to rectify.
+	 * @param[in] aInputManager	The input manager that gives access to all given initial data
+	 */
+	FacadeRectifier(vector<Vector3d> const &aPoints, Vector4d const &aPlane, inputManager* aInputManager);
+
+	/*!
+	 * Returns whether at least one texture pixel was covered by a view.
+	 */
+	bool hasTexture() const;
+
+	/*!
+	 * Calculates the texture pixel of a point on the plane.
+	 *
+	 * @param[in] point		The 3d point. It is projected onto the plane first.
+	 * @return	The (sub-)pixel position (x,y) of the point in the texture. May lie outside the texture.
+	 */
+	Vector2d pointToTexture(Vector3d const &point) const;
+
+	/*!
+	 * Checks for a set of points whether their appearance in the texture is similar to the reference point's appearance,
+	 * i.e. the NCC of the patches around them is at least NCC_TRESHOLD.
+	 *
+	 * @param[in] referencePoint	The reference point.
+	 * @param[in] pointsToTest		The points to compare with the reference point.
+	 * @return	For every point to test, whether it looks similar to the reference point. Points whose patch is not completely
+	 * 			covered by the texture are never similar.
+	 */
+	vector<bool> arePointsSimilar(Vector3d const &referencePoint, vector<Vector3d> const &pointsToTest) const;
+
+	/*!
+	 * Calculates the normalized cross correlation of the square patches (radius PATCH_RADIUS) around two texture pixels.
+	 *
+	 * @param[in] x1,y1		The center of the first patch.
+	 * @param[in] x2,y2		The center of the second patch.
+	 * @return	The NCC in [-1,1], or -1 if one of the patches is not completely covered or has no texture at all.
+	 */
+	double normalizedCrossCorrelation(int x1, int y1, int x2, int y2) const;
+
+	/*! Returns the rectified texture (CV_32FC1, gray values). */
+	cv::Mat const &getTexture() const;
+
+	/*! Returns the coverage mask of the texture (CV_8UC1, 255 where a view covered the pixel, 0 elsewhere). */
+	cv::Mat const &getCoverage() const;
+
+	/*! Returns the frame of the plane. Texture pixel (x,y) lies at plane coordinates textureOrigin + pixelSize*(x,y). */
+	PlaneFrame const &getFrame() const;
+
+	/*! Returns the plane coordinates of texture pixel (0,0). */
+	Vector2d getTextureOrigin() const;
+
+	/*! Returns the edge length of a texture pixel on the plane. */
+	double getPixelSize() const;
+
+	// CONSTANTS
+
+	static constexpr double PIXEL_SIZE = 0.005;		/*!< Edge length of a texture pixel on the plane, if the texture does not exceed MAX_TEXTURE_SIZE.
+															The shortest accepted lattice basis vector (LatticeDetector::VECTOR_DISTANCE) spans 12 pixels. */
+
+	static constexpr int MAX_TEXTURE_SIZE = 2048;	/*!< Maximum width and height of the texture. Larger planes get a larger pixel size. */
+
+	static constexpr double TEXTURE_MARGIN = 0.5;	/*!< The texture covers the bounding box of the points, enlarged by this fraction of its size on
+															every side, as lattices expand beyond the points they were fit into. */
+
+	static constexpr int PATCH_RADIUS = 8;			/*!< Radius of the compared patches in texture pixels. The patch size is (2*PATCH_RADIUS+1)^2. */
+
+	static constexpr double NCC_TRESHOLD = 0.7;		/*!< Minimum NCC of two patches to call them similar. */
+
+private:
+
+	inputManager* inpManager;	/*!< The input manager that gives access to all given initial data. */
+
+	Vector4d plane;				/*!< The rectified plane. */
+
+	PlaneFrame frame;			/*!< The frame of the plane, the texture axes are aligned with its axes. */
+
+	Vector2d textureOrigin;		/*!< Plane coordinates of texture pixel (0,0). */
+
+	double pixelSize;			/*!< Edge length of a texture pixel on the plane. */
+
+	cv::Mat texture;			/*!< The rectified texture (CV_32FC1). */
+
+	cv::Mat coverage;			/*!< The coverage mask (CV_8UC1). */
+
+	vector<double> integral;			/*!< Integral image of the texture, (width+1)*(height+1) entries. */
+	vector<double> integralSquared;		/*!< Integral image of the squared texture. */
+	vector<int> integralCoverage;		/*!< Integral image of the coverage (1 per covered pixel). */
+
+	/*!
+	 * Warps the considered views into the texture. Every texture pixel is taken from the most frontoparallel view that sees it.
+	 */
+	void rectify();
+
+	/*!
+	 * Computes the integral images of the texture, the squared texture and the coverage.
+	 */
+	void computeIntegralImages();
+
+	/*!
+	 * Sums up the entries of an integral image over the patch around a pixel.
+	 */
+	template <typename T>
+	T patchSum(vector<T> const &integralImage, int x, int y) const;
+
+	/*!
+	 * Returns whether the patch around a texture pixel is completely covered.
+	 */
+	bool patchIsCovered(int x, int y) const;
+};
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <vector>
+#include <complex>
+#include <math.h>
+
+using namespace std;
+
+/*!
+ * Returns the smallest power of two that is >= n.
+ */
+inline int nextPowerOfTwo(int n)
+{
+    int power = 1;
+    while (power < n)
+    {
+        power <<= 1;
+    }
+    return power;
+}
+
+/*!
+ * In-place iterative radix-2 fast Fourier transform.
+ *
+ * @param[in,out] data the sequence to transform. Its length must be a power of two.
+ * @param[in] inverse if true, the inverse transform (including the 1/n scaling) is computed
+ */
+inline void fft1d(vector<complex<double> > &data, bool inverse)
+{
+    size_t n = data.size();
+
+    // bit reversal permutation
+    for (size_t i = 1, j = 0; i < n; i++)
+    {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            swap(data[i], data[j]);
+        }
+    }
+
+    // butterflies
+    for (size_t length = 2; length <= n; length <<= 1)
+    {
+        double angle = 2*M_PI/length * (inverse ? 1 : -1);
+        complex<double> rootStep(cos(angle), sin(angle));
+
+        for (size_t start = 0; start < n; start += length)
+        {
+            complex<double> root(1, 0);
+            for (size_t k = 0; k < length/2; k++)
+            {
+                complex<double> even = data[start+k];
+                complex<double> odd = data[start+k+length/2]*root;
+                data[start+k] = even + odd;
+                data[start+k+length/2] = even - odd;
+                root *= rootStep;
+            }
+        }
+    }
+
+    if (inverse)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            data[i] /= (double)n;
+        }
+    }
+}
+
+/*!
+ * In-place 2d fast Fourier transform of a row-major image, as 1d transforms of all rows and then all columns.
+ *
+ * @param[in,out] data the image to transform, width*height entries
+ * @param[in] width the width of the image. Must be a power of two.
+ * @param[in] height the height of the image. Must be a power of two.
+ * @param[in] inverse if true, the inverse transform is computed
+ */
+inline void fft2d(vector<complex<double> > &data, int width, int height, bool inverse)
+{
+    vector<complex<double> > line(width);
+    for (int y = 0; y < height; y++)
+    {
+        copy(data.begin() + y*width, data.begin() + (y+1)*width, line.begin());
+        fft1d(line, inverse);
+        copy(line.begin(), line.end(), data.begin() + y*width);
+    }
+
+    line.resize(height);
+    for (int x = 0; x < width; x++)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            line[y] = data[y*width + x];
+        }
+        fft1d(line, inverse);
+        for (int y = 0; y < height; y++)
+        {
+            data[y*width + x] = line[y];
+        }
+    }
+}
+
+/*!
+ * Computes the 2d autocorrelation of a row-major image via the FFT (Wiener-Khinchin). The image is zero-padded to at least twice
+ * its size, so there is no wrap-around between shifts.
+ *
+ * @param[in] image the image, width*height entries
+ * @param[in] width the width of the image
+ * @param[in] height the height of the image
+ * @param[out] paddedWidth the width of the returned autocorrelation
+ * @param[out] paddedHeight the height of the returned autocorrelation
+ * @return the autocorrelation. The value for shift (dx,dy) is stored at ((dy+paddedHeight)%paddedHeight)*paddedWidth + (dx+paddedWidth)%paddedWidth,
+ *         for |dx| < width and |dy| < height.
+ */
+inline vector<double> autocorrelation2d(vector<double> const &image, int width, int height, int &paddedWidth, int &paddedHeight)
+{
+    paddedWidth = nextPowerOfTwo(2*width);
+    paddedHeight = nextPowerOfTwo(2*height);
+
+    vector<complex<double> > data(paddedWidth*paddedHeight, complex<double>(0,0));
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            data[y*paddedWidth + x] = image[y*width + x];
+        }
+    }
+
+    fft2d(data, paddedWidth, paddedHeight, false);
+
+    // power spectrum
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = norm(data[i]);
+    }
+
+    fft2d(data, paddedWidth, paddedHeight, true);
+
+    vector<double> result(data.size());
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        result[i] = data[i].real();
+    }
+
+    return result;
+}
+
+#endif // FFT_H
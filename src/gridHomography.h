@@ -0,0 +1,111 @@
+#ifndef GRIDHOMOGRAPHY_H
+#define GRIDHOMOGRAPHY_H
+
+#include <vector>
+#include <memory>
+#include <Eigen/Dense>
+
+#include "latticeStruct.h"
+#include "cameraRig.h"
+
+using namespace Eigen;
+using namespace std;
+
+/*!< struct for the projection of a lattice grid into one camera: the plane-induced homography from grid coordinates (i,j) to pixels.
+ * A grid point X(i,j) = corner + i*basisVectors[0] + j*basisVectors[1] projects with P = K[R|t] to
+ * 		P(X(i,j),1) = [P_3 b0 | P_3 b1 | P_3 corner + p_4] (i,j,1) = H (i,j,1),
+ * P_3 being the left 3x3 block of P. The third row of K is (0,0,1), so the homogeneous coordinate w of H(i,j,1) is the depth of X(i,j),
+ * times depthSign: depthSign*w > 0 for points in front of the camera. */
+struct GridHomography
+{
+	int camera;					/*!< Index of the camera pose. */
+	int view;					/*!< Index of the image of the camera. */
+	Matrix3d H;					/*!< Homography from (i,j,1) to homogeneous pixel coordinates. */
+	double depthSign;			/*!< Sign of the third row of K, depthSign*w is the depth. */
+	Vector3d cornerOffset;		/*!< corner - position of the camera (the translation column, as used by the view selection). */
+
+	/*! Returns the pixel of grid point (i,j), and its depth in depthOut. */
+	Vector2d project(double i, double j, double &depthOut) const{
+		Vector3d p = H*Vector3d(i, j, 1);
+		depthOut = depthSign*p(2);
+		return p.head<2>()/p(2);
+	}
+
+	/*!
+	 * Projects many grid points at once.
+	 *
+	 * @param[in] ij		The grid coordinates, one column per grid point.
+	 * @param[out] pixels	The pixels, one column per grid point.
+	 * @param[out] depths	The depths.
+	 */
+	void project(Matrix<double,2,Dynamic> const &ij, Matrix<double,2,Dynamic> &pixels, ArrayXd &depths) const{
+		Matrix<double,3,Dynamic> projected = (H.leftCols<2>()*ij).colwise() + H.col(2);
+		depths = depthSign*projected.row(2).transpose().array();
+		pixels = projected.topRows<2>().array().rowwise() / projected.row(2).array();
+	}
+};
+
+/**
+ * \class GridHomographies
+ *
+ *
+ * The homographies of one lattice grid into all cameras, computed once. They depend on the lattice structure (corner and basis vectors)
+ * and on the cameras only, matches() tells whether they are still valid after either changed.
+ *
+ */
+class GridHomographies {
+
+public:
+
+	GridHomographies(){}
+
+	/*!
+	 * Computes the homographies of a lattice into all cameras.
+	 *
+	 * @param[in] lattice	The lattice structure, with two basis vectors.
+	 * @param[in] aRig		The cameras.
+	 */
+	GridHomographies(LatticeStructure const &lattice, shared_ptr<CameraRig const> aRig){
+		corner = lattice.corner;
+		basis0 = lattice.basisVectors[0];
+		basis1 = lattice.basisVectors[1];
+		rig = aRig;
+
+		double depthSign = (rig->getK()(2,2) < 0) ? -1 : 1;
+
+		homographies.resize(rig->size());
+		for (int c = 0; c < rig->size(); c++){
+			Matrix<double,3,4> const &P = rig->projection(c);
+			GridHomography &homography = homographies[c];
+			homography.camera = c;
+			homography.view = rig->view(c);
+			homography.H.col(0) = P.leftCols<3>()*basis0;
+			homography.H.col(1) = P.leftCols<3>()*basis1;
+			homography.H.col(2) = P.leftCols<3>()*corner + P.col(3);
+			homography.depthSign = depthSign;
+			homography.cornerOffset = corner - rig->position(c);
+		}
+	}
+
+	/*! Returns whether the homographies were computed for this lattice structure and these cameras. Rigs are immutable, so they are compared by identity. */
+	bool matches(LatticeStructure const &lattice, CameraRig const *aRig) const{
+		return (lattice.basisVectors.size() == 2) && (lattice.corner == corner) && (lattice.basisVectors[0] == basis0)
+				&& (lattice.basisVectors[1] == basis1) && (aRig == rig.get());
+	}
+
+	/*! Returns the homographies, one per camera, in the order of the camera poses. */
+	vector<GridHomography> const &cameras() const{
+		return homographies;
+	}
+
+private:
+
+	Vector3d corner;
+	Vector3d basis0;
+	Vector3d basis1;
+	shared_ptr<CameraRig const> rig;	/*!< The cameras, kept so that a new rig never has the address of this one. */
+
+	vector<GridHomography> homographies;
+};
+
+#endif
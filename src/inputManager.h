@@ -5,10 +5,14 @@
 #include <Eigen/Dense>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <memory>
 
 
 #include "CImg.h"
 #include "camera.h"
+#include "cameraRig.h"
 #include "latticeStruct.h" 
 
 using namespace std;
@@ -34,6 +38,17 @@ class inputManager{
 
 	vector<Eigen::Matrix<double,3,4>> camPoses;
 
+	/*!< struct for the sizes of the images that were already loaded, shared by the copies of an inputManager */
+	struct ImageSizeCache
+	{
+		mutex sizesMutex;					/*!< Guards sizes, the cache is used from several threads. */
+		map<int, pair<int,int> > sizes;		/*!< Width and height of the image, per view. */
+	};
+
+	shared_ptr<ImageSizeCache> imageSizeCache = make_shared<ImageSizeCache>();
+
+	shared_ptr<CameraRig const> cameraRig = make_shared<CameraRig const>();	/*!< The cameras, set up once, see getCameraRig(). */
+
 
 public:
 
@@ -70,11 +85,101 @@ public:
 
 	void setCamPoses(vector<Eigen::Matrix<double,3,4>> newcams ){
 			this->camPoses = vector<Eigen::Matrix<double,3,4>>(newcams);
+			this->cameraRig = make_shared<CameraRig const>(camK, camPoses, viewIds);
+	}
+
+	/*!
+	 * Returns the cameras, set up once when they are read and again when they are changed with setCamPoses.
+	 * The rig is immutable, so it may be used from several threads and kept while the inputManager changes.
+	 */
+	shared_ptr<CameraRig const> getCameraRig() const{
+		return this->cameraRig;
 	}
 
 	vector<int> getViewIds(){
 		return this->viewIds;
 	}
+
+	/*!
+	 * Returns the size of the image of a view. The image is loaded only the first time, afterwards the size is cached.
+	 * May be called from several threads at once.
+	 *
+	 * @param[in] view the view (index into getImgNames())
+	 * @param[out] width the width of the image, 0 if it could not be loaded
+	 * @param[out] height the height of the image, 0 if it could not be loaded
+	 * @return false if the image could not be loaded
+	 */
+	bool getImageSize(int view, int &width, int &height){
+		{
+			lock_guard<mutex> lock(imageSizeCache->sizesMutex);
+			map<int, pair<int,int> >::const_iterator cached = imageSizeCache->sizes.find(view);
+			if (cached != imageSizeCache->sizes.end()){
+				width = cached->second.first;
+				height = cached->second.second;
+				return (width > 0);
+			}
+		}
+
+		// loaded without holding the lock, a second thread may load the same image meanwhile
+		width = 0;
+		height = 0;
+		try{
+			cimg_library::CImg<unsigned char> image(("data/"+imageNames[view]).c_str());
+			width = image.width();
+			height = image.height();
+		}
+		catch (cimg_library::CImgException const &e){
+			cout << "Could not load image " << imageNames[view] << endl;
+		}
+
+		lock_guard<mutex> lock(imageSizeCache->sizesMutex);
+		imageSizeCache->sizes[view] = make_pair(width, height);
+		return (width > 0);
+	}
+
+	/*!
+	 * Sums the reprojection errors (in pixels) of the measurements of some points of the pointModel. The measurements are grouped
+	 * by camera and every camera of the rig projects its points in one batch (see CameraMatrix::projectPoints). Measurements in views
+	 * without a camera are skipped.
+	 *
+	 * @param[in] pointIndices the indices of the points in the pointModel
+	 * @return the sum of the distances between the projected points and their measurements
+	 */
+	float reprojectionError(vector<int> const &pointIndices){
+		CameraRig const &rig = *cameraRig;
+
+		// the points and measured pixels of every camera
+		vector<vector<Eigen::Vector3d> > pointsOfCamera(rig.size());
+		vector<vector<Eigen::Vector2f> > measurementsOfCamera(rig.size());
+		for (size_t p = 0; p < pointIndices.size(); p++){
+			TriangulatedPoint const &point = pointModel[pointIndices[p]];
+			for (size_t j = 0; j < point.measurements.size(); j++){
+				int camera = rig.cameraOfView(point.measurements[j].view);
+				if (camera < 0){
+					continue;
+				}
+				pointsOfCamera[camera].push_back(point.pos);
+				measurementsOfCamera[camera].push_back(point.measurements[j].pos);
+			}
+		}
+
+		ProjectedPoints projected;
+
+		float reprojectionError = 0;
+		for (int c = 0; c < rig.size(); c++){
+			if (pointsOfCamera[c].empty()){
+				continue;
+			}
+			rig.camera(c).projectPoints(toPointArray(pointsOfCamera[c]), 0, 0, projected);
+
+			for (size_t k = 0; k < measurementsOfCamera[c].size(); k++){
+				reprojectionError += (projected.pixel(k).cast<float>() - measurementsOfCamera[c][k]).norm();
+			}
+		}
+
+		return reprojectionError;
+	}
+
 	vector<Eigen::Vector3d> getPoints(){
 		return this->allPoints;
 	}
@@ -86,6 +191,7 @@ public:
 	inputManager(char** argv){
 		read3Dpoints(argv[2],allPoints,pointModel);
 		readCameras(argv[3],argv[4],camPoses,camK, viewIds);
+		cameraRig = make_shared<CameraRig const>(camK, camPoses, viewIds);
 		readImgNames(argv[1],imageNames);
 	}
 
@@ -0,0 +1,302 @@
+#ifndef LATTICECACHE_H
+#define LATTICECACHE_H
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "latticeClass.h"
+
+using namespace std;
+
+/**
+ * \class LatticeCache
+ *
+ *
+ * Caches the results of LatticeClass::fitLattice in a directory, one file per fit, named after a key that hashes (64 bit FNV-1a) everything
+ * the fit depends on:
+ * 	- the indices and positions of the points of the group, and the plane if it is given,
+ * 	- the configuration of the lattice (validity and candidate modes, RANSAC seed, step budget),
+ * 	- the parameters of the PlaneFitter and the LatticeDetector,
+ * 	- the inputs shared by all fits: intrinsics, camera poses, view ids, and the names and file contents of the images.
+ * A fit with the same key gives the same lattice (the plane fitting RANSAC is seeded, see ransacSeed), so it is loaded instead of refitted,
+ * and only groups whose inputs changed are fitted again. Changing a parameter that is not hashed needs FORMAT_VERSION to be increased.
+ *
+ * The files have the format of LatticeClass::saveLatticeToFile, an empty file records that no lattice was found. Next to each, a .inliers
+ * file keeps the indices of the points on the plane (count, then the indices). Fits stopped early by a budget or cancellation are not stored,
+ * they depend on timing. Only the saved fields are restored (structure, on-grid points and plane inliers), as for the lattices loaded
+ * from ./data/savedLattices.
+ *
+ */
+class LatticeCache {
+
+public:
+
+	static constexpr uint32_t FORMAT_VERSION = 3;	/*!< Version of the key and file format, increase it to invalidate all cached fits. */
+
+	/*!
+	 * The constructor.
+	 *
+	 * @param[in] inpm			The input manager the lattices are fitted with.
+	 * @param[in] aDirectory	The directory of the cached fits, created if missing.
+	 */
+	LatticeCache(inputManager &inpm, string aDirectory){
+		directory = aDirectory;
+		mkdir(directory.c_str(), 0755);
+
+		// the inputs shared by all fits are hashed once
+		sharedHash = FNV_OFFSET_BASIS;
+		hashValue(sharedHash, FORMAT_VERSION);
+
+		Matrix3d K = inpm.getK();
+		hashBytes(sharedHash, K.data(), K.size()*sizeof(double));
+
+		vector<Matrix<double,3,4> > camPoses = inpm.getCamPoses();
+		hashValue(sharedHash, (uint64_t)camPoses.size());
+		for (size_t c = 0; c < camPoses.size(); c++){
+			hashBytes(sharedHash, camPoses[c].data(), camPoses[c].size()*sizeof(double));
+		}
+
+		vector<int> viewIds = inpm.getViewIds();
+		hashVector(sharedHash, viewIds);
+
+		vector<string> imageNames = inpm.getImgNames();
+		hashValue(sharedHash, (uint64_t)imageNames.size());
+		for (size_t i = 0; i < imageNames.size(); i++){
+			hashValue(sharedHash, (uint64_t)imageNames[i].size());
+			hashBytes(sharedHash, imageNames[i].data(), imageNames[i].size());
+
+			// a changed image under the same name changes the key too, whatever its size and modification time
+			hashFile(sharedHash, "data/" + imageNames[i]);
+		}
+
+		// plane fitter and detector parameters
+		PlaneFitter planeFitter;
+		hashValue(sharedHash, planeFitter.RANSAC_THRESH);
+		hashValue(sharedHash, PlaneFitter::RANSAC_MAX_ITERATIONS);
+		hashValue(sharedHash, PlaneFitter::RANSAC_MIN_ITERATIONS);
+		hashValue(sharedHash, PlaneFitter::RANSAC_CONFIDENCE);
+		hashValue(sharedHash, PlaneFitter::RANSAC_LOCAL_REFINEMENTS);
+		hashValue(sharedHash, PlaneFitter::RANSAC_BLOCK_SIZE);
+		hashValue(sharedHash, PlaneFitter::SPRT_INITIAL_DELTA);
+		hashValue(sharedHash, PlaneFitter::SPRT_THRESHOLD);
+		hashValue(sharedHash, PlaneFitter::IRLS_ITERATIONS);
+
+		hashValue(sharedHash, LatticeDetector::VECTOR_DISTANCE);
+		hashValue(sharedHash, LatticeDetector::TRESHOLD1);
+		hashValue(sharedHash, LatticeDetector::TRESHOLD2);
+		hashValue(sharedHash, LatticeDetector::ANGLETRESHOLD);
+		hashValue(sharedHash, LatticeDetector::AUTOCORRELATION_MAX_SIZE);
+		hashValue(sharedHash, LatticeDetector::AUTOCORRELATION_MAX_CANDIDATES);
+		hashValue(sharedHash, LatticeDetector::AUTOCORRELATION_PEAK_RATIO);
+		hashValue(sharedHash, LatticeDetector::AUTOCORRELATION_MIN_OVERLAP);
+		hashValue(sharedHash, LatticeDetector::OCCUPANCY_PIXEL_SIZE);
+		hashValue(sharedHash, LatticeDetector::OCCUPANCY_TOLERANCE);
+		hashValue(sharedHash, LatticeDetector::OCCUPANCY_TIE_RATIO);
+		hashValue(sharedHash, LatticeDetector::OCCUPANCY_SHORTLIST_SIZE);
+		hashValue(sharedHash, LatticeDetector::EXPANSION_BATCH_SIZE);
+	}
+
+	/*!
+	 * Calculates the key of a fit.
+	 *
+	 * @param[in] lattice	The configured, not yet fitted lattice.
+	 * @param[in] plane		The plane the lattice is fitted on, NULL if the plane is fitted to the points.
+	 * @return	The key of the fit.
+	 */
+	uint64_t key(LatticeClass const &lattice, Vector4d const *plane = NULL) const{
+		uint64_t hash = sharedHash;
+
+		hashVector(hash, lattice.groupPointsIdx);
+		hashValue(hash, (uint64_t)lattice.pointsInGroup.size());
+		for (size_t i = 0; i < lattice.pointsInGroup.size(); i++){
+			hashBytes(hash, lattice.pointsInGroup[i].data(), 3*sizeof(double));
+		}
+
+		hashValue(hash, (uint8_t)(plane != NULL));
+		if (plane != NULL){
+			hashBytes(hash, plane->data(), 4*sizeof(double));
+		}
+
+		hashValue(hash, (int32_t)lattice.validityMode);
+		hashValue(hash, (int32_t)lattice.tieBreakValidityMode);
+		hashValue(hash, (int32_t)lattice.candidateMode);
+		hashValue(hash, lattice.ransacSeed);
+		hashValue(hash, (int64_t)((lattice.stepBudget > 0) ? lattice.stepBudget : 0));
+
+		return hash;
+	}
+
+	/*!
+	 * Loads a cached fit.
+	 *
+	 * @param[in] aKey			The key of the fit.
+	 * @param[in,out] lattice	The lattice to restore the fit to.
+	 * @return	Whether the fit was cached.
+	 */
+	bool load(uint64_t aKey, LatticeClass &lattice){
+		string file = fileName(aKey);
+
+		struct stat fileStatus;
+		if (stat(file.c_str(), &fileStatus) != 0){
+			misses++;
+			return false;
+		}
+
+		vector<int> planeInliers;
+		if (!loadInliers(inliersFileName(aKey), planeInliers)){
+			misses++;
+			return false;
+		}
+		lattice.planeInlierIdx = planeInliers;
+
+		if (fileStatus.st_size == 0){
+			// no lattice was found
+			lattice.LattStructure = LatticeStructure();
+			lattice.latticeGridIndices.clear();
+		}
+		else{
+			lattice.loadFromFile(file.c_str());
+		}
+		hits++;
+		return true;
+	}
+
+	/*!
+	 * Stores a fit, unless it was stopped early. The files are written under temporary names unique to the process and the call,
+	 * and renamed, so a stopped run leaves no partial files behind and concurrent stores of the same key do not interfere.
+	 * The lattice file is renamed last, a fit counts as cached only once both files are in place.
+	 *
+	 * @param[in] aKey		The key of the fit, calculated before fitting.
+	 * @param[in] lattice	The fitted lattice.
+	 */
+	void store(uint64_t aKey, LatticeClass &lattice){
+		if (lattice.fitStats.stopReason != SearchBudget::NOT_STOPPED){
+			return;
+		}
+		string suffix = "." + to_string(getpid()) + "_" + to_string(temporaryCount++) + ".tmp";
+
+		string inliersFile = inliersFileName(aKey);
+		string temporaryInliersFile = inliersFile + suffix;
+		ofstream inliers(temporaryInliersFile.c_str());
+		inliers << lattice.planeInlierIdx.size() << endl;
+		for (size_t i = 0; i < lattice.planeInlierIdx.size(); i++){
+			inliers << lattice.planeInlierIdx[i] << endl;
+		}
+		inliers.close();
+		if (!inliers){
+			remove(temporaryInliersFile.c_str());
+			return;
+		}
+		rename(temporaryInliersFile.c_str(), inliersFile.c_str());
+
+		string file = fileName(aKey);
+		string temporaryFile = file + suffix;
+		lattice.saveLatticeToFile(temporaryFile.c_str());
+		rename(temporaryFile.c_str(), file.c_str());
+	}
+
+	/*! Returns the file of the fit with the given key. */
+	string fileName(uint64_t aKey) const{
+		ostringstream name;
+		name << directory << "/" << hex << setw(16) << setfill('0') << aKey << ".txt";
+		return name.str();
+	}
+
+	/*! Returns the file of the plane inliers of the fit with the given key. */
+	string inliersFileName(uint64_t aKey) const{
+		ostringstream name;
+		name << directory << "/" << hex << setw(16) << setfill('0') << aKey << ".inliers";
+		return name.str();
+	}
+
+	/*! Returns the number of fits that were loaded. */
+	int getHits() const{
+		return hits;
+	}
+
+	/*! Returns the number of fits that were not cached. */
+	int getMisses() const{
+		return misses;
+	}
+
+private:
+
+	static constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+
+	static constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+	string directory;
+
+	uint64_t sharedHash;	/*!< Hash of the inputs shared by all fits. */
+
+	atomic<int> hits{0};
+
+	atomic<int> misses{0};
+
+	atomic<int> temporaryCount{0};	/*!< Makes the temporary file names of concurrent stores unique. */
+
+	/*! Reads the plane inliers of a fit, false if the file is missing or incomplete. */
+	static bool loadInliers(string const &file, vector<int> &planeInliers){
+		ifstream inliers(file.c_str());
+		size_t count = 0;
+		if (!(inliers >> count)){
+			return false;
+		}
+		planeInliers.resize(count);
+		for (size_t i = 0; i < count; i++){
+			if (!(inliers >> planeInliers[i])){
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/*! Adds bytes to an FNV-1a hash. */
+	static void hashBytes(uint64_t &hash, void const *data, size_t size){
+		unsigned char const *bytes = (unsigned char const *)data;
+		for (size_t i = 0; i < size; i++){
+			hash = (hash ^ bytes[i]) * FNV_PRIME;
+		}
+	}
+
+	/*! Adds the size and the bytes of a file to an FNV-1a hash, or -1 if it cannot be read. */
+	static void hashFile(uint64_t &hash, string const &file){
+		ifstream stream(file.c_str(), ios::binary);
+		if (!stream){
+			hashValue(hash, (int64_t)-1);
+			return;
+		}
+		vector<char> buffer(1 << 16);
+		int64_t size = 0;
+		while (stream){
+			stream.read(buffer.data(), buffer.size());
+			hashBytes(hash, buffer.data(), stream.gcount());
+			size += stream.gcount();
+		}
+		hashValue(hash, size);
+	}
+
+	/*! Adds a value to an FNV-1a hash. */
+	template <typename T>
+	static void hashValue(uint64_t &hash, T value){
+		hashBytes(hash, &value, sizeof(T));
+	}
+
+	/*! Adds the size and the elements of a vector to an FNV-1a hash. */
+	static void hashVector(uint64_t &hash, vector<int> const &values){
+		hashValue(hash, (uint64_t)values.size());
+		if (!values.empty()){
+			hashBytes(hash, values.data(), values.size()*sizeof(int));
+		}
+	}
+};
+
+#endif
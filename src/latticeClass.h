@@ -8,12 +8,22 @@
 #include "planeFitter.h"
 #include "latticeDetector.h"
 #include "latticeStruct.h"
+#include "gridHomography.h"
 #include "my_v3d_vrmlio.h" // already imported in main_test2
 
 #include <iomanip>
+#include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+
+#include "parallel.h"
 
 using namespace std;
 
+struct ConsolidatedLattices;
+
 class LatticeClass {
 
 	LatticeDetector* LattDetector;
@@ -21,10 +31,12 @@ class LatticeClass {
 
 	bool computeDensifyingPoints = false;
 	vector<TriangulatedPoint> densifyingPoints;
-	vector<pair<int, vector<int> > > densifyingLatticeGridIndices;
+	vector<LatticeGridIndex> densifyingLatticeGridIndices;
 	string densifyingPointsFile = "data/densifyingPoints.txt";
 	string densifyingPointsIndicesFile = "data/densifyingPointsIndices.txt";
 
+	mutable shared_ptr<GridHomographies const> gridHomographies;	/*!< The homographies of the grid into the cameras, see getGridHomographies(). */
+
 
 public:
 
@@ -38,10 +50,28 @@ public:
 
 	LatticeStructure LattStructure; /* !< struct to save the fields related to a lattice's geometry */
 
-	vector<pair<int, vector<int> > > latticeGridIndices;
+	vector<LatticeGridIndex> latticeGridIndices; /* !< the on-grid points with their grid coordinates */
 
 	int consolidationTransformation;
 
+	LatticeDetector::ValidityMode validityMode = LatticeDetector::SIFT_VALIDATION; /* !< how the detector decides grid point validity */
+
+	LatticeDetector::ValidityMode tieBreakValidityMode = LatticeDetector::OCCUPANCY_VALIDATION; /* !< appearance tie break in OCCUPANCY_VALIDATION, OCCUPANCY_VALIDATION for none */
+
+	LatticeDetector::CandidateMode candidateMode = LatticeDetector::PAIRWISE_CANDIDATES; /* !< how the detector generates candidate basis vectors */
+
+	unsigned int ransacSeed = PlaneFitter::DEFAULT_SEED; /* !< seed of the plane fitting RANSAC, the same seed gives the same lattice */
+
+	double timeBudgetSeconds = 0; /* !< time budget of fitLattice, <= 0 for unlimited */
+
+	long stepBudget = 0; /* !< budget of validated grid points in fitLattice, <= 0 for unlimited */
+
+	shared_ptr<atomic<bool> > cancellationToken; /* !< set to true to stop fitLattice early, may be shared by many lattices. May be NULL */
+
+	LatticeFitStats fitStats; /* !< statistics of the last fitLattice, including whether a budget stopped it */
+
+	int detectorThreads = 0; /* !< threads of the detector's candidate validation, <= 0 for all. 1 when lattices are fitted concurrently */
+
 	inputManager* inpM;
 
 	/*! Constructor
@@ -67,8 +97,8 @@ public:
 			const char* file){
 		LattDetector = NULL;
 		this->inpM = &inpm;
-		this->pointsInGroup  = _groupPoints;
-		this->groupPointsIdx = _groupPointsIndices;
+		this->pointsInGroup  = std::move(_groupPoints);
+		this->groupPointsIdx = std::move(_groupPointsIndices);
 		consolidationTransformation = -1;
 		loadFromFile(file);
 	}
@@ -80,49 +110,195 @@ public:
 	/*! Copy Constructor
 	*/
 	LatticeClass(const LatticeClass& cSource) {
+		LattDetector = NULL;
+		assignFrom(cSource);
+	}
 
+	/*! Move Constructor, takes over the point and grid index vectors instead of copying them
+	*/
+	LatticeClass(LatticeClass&& cSource) noexcept {
 		LattDetector = NULL;
+		assignFrom(std::move(cSource));
+	}
+
+	LatticeClass& operator=(const LatticeClass& cSource) {
+		if (this != &cSource){
+			assignFrom(cSource);
+		}
+		return *this;
+	}
+
+	LatticeClass& operator=(LatticeClass&& cSource) noexcept {
+		if (this != &cSource){
+			assignFrom(std::move(cSource));
+		}
+		return *this;
+	}
+
+	/*! Copies (or moves, for an rvalue) the fields of another lattice. The detector is never shared. Every copy is counted, see copyStatistics(). */
+	template <typename Source>
+	void assignFrom(Source&& cSource) {
+
+		if (std::is_lvalue_reference<Source>::value){
+			copyStatistics().copies++;
+			copyStatistics().copiedBytes += cSource.memoryFootprint();
+		}
+		else{
+			copyStatistics().moves++;
+		}
 
 		inpM = cSource.inpM;
 
-		groupPointsIdx = vector<int>(cSource.groupPointsIdx);
-		pointsInGroup = vector<Vector3d>(cSource.pointsInGroup);
+		groupPointsIdx = std::forward<Source>(cSource).groupPointsIdx;
+		pointsInGroup = std::forward<Source>(cSource).pointsInGroup;
 
 		LattStructure = cSource.LattStructure;
 
-		planeInliersProjected = vector<Vector3d>(cSource.planeInliersProjected);
-		planeInlierIdx = vector<int>(cSource.planeInlierIdx);
+		planeInliersProjected = std::forward<Source>(cSource).planeInliersProjected;
+		planeInlierIdx = std::forward<Source>(cSource).planeInlierIdx;
 
-		latticeGridIndices = vector<pair<int, vector<int> > >(cSource.latticeGridIndices);
+		latticeGridIndices = std::forward<Source>(cSource).latticeGridIndices;
+
+		computeDensifyingPoints = cSource.computeDensifyingPoints;
+		densifyingPoints = std::forward<Source>(cSource).densifyingPoints;
+		densifyingLatticeGridIndices = std::forward<Source>(cSource).densifyingLatticeGridIndices;
+		densifyingPointsFile = std::forward<Source>(cSource).densifyingPointsFile;
+		densifyingPointsIndicesFile = std::forward<Source>(cSource).densifyingPointsIndicesFile;
 
 		consolidationTransformation = cSource.consolidationTransformation;
+
+		validityMode = cSource.validityMode;
+
+		tieBreakValidityMode = cSource.tieBreakValidityMode;
+
+		candidateMode = cSource.candidateMode;
+
+		ransacSeed = cSource.ransacSeed;
+
+		timeBudgetSeconds = cSource.timeBudgetSeconds;
+		stepBudget = cSource.stepBudget;
+		cancellationToken = cSource.cancellationToken;
+		fitStats = cSource.fitStats;
+		detectorThreads = cSource.detectorThreads;
+
+		gridHomographies = atomic_load(&cSource.gridHomographies);
+	}
+
+	/*!< struct to count the copies and moves of lattices, to monitor the memory traffic of the pipeline */
+	struct CopyStatistics
+	{
+		atomic<long> copies;		/*!< Number of lattice copies. */
+		atomic<long> moves;			/*!< Number of lattice moves. */
+		atomic<long> copiedBytes;	/*!< Bytes copied by the lattice copies (see memoryFootprint()). */
+
+		CopyStatistics() : copies(0), moves(0), copiedBytes(0) {}
+	};
+
+	/*! Returns the copy and move counters of all lattices. */
+	static CopyStatistics &copyStatistics(){
+		static CopyStatistics statistics;
+		return statistics;
+	}
+
+	/*! Prints the copy and move counters of all lattices. */
+	static void printCopyStatistics(){
+		cout << "lattice copies: " << copyStatistics().copies << " (" << copyStatistics().copiedBytes << " bytes), moves: "
+				<< copyStatistics().moves << endl;
+	}
+
+	/*! Returns the bytes of the lattice's own data, the object and the contents of its vectors. */
+	size_t memoryFootprint() const {
+		size_t bytes = sizeof(LatticeClass);
+		bytes += pointsInGroup.capacity()*sizeof(Vector3d) + groupPointsIdx.capacity()*sizeof(int);
+		bytes += planeInliersProjected.capacity()*sizeof(Vector3d) + planeInlierIdx.capacity()*sizeof(int);
+		bytes += latticeGridIndices.capacity()*sizeof(LatticeGridIndex);
+		bytes += densifyingLatticeGridIndices.capacity()*sizeof(LatticeGridIndex);
+		for (size_t i = 0; i < densifyingPoints.size(); i++){
+			bytes += sizeof(TriangulatedPoint) + densifyingPoints[i].measurements.capacity()*sizeof(PointMeasurement);
+		}
+		return bytes;
 	}
 
 	/*! Method to calculate the lattice end-to-end
 	 * will populate the fields of 
+	 * The search is limited by timeBudgetSeconds, stepBudget and cancellationToken. If one of them stops it, the best lattice found so far
+	 * is kept, and fitStats.stopReason tells why.
 	*/
     void fitLattice(){
 
+	SearchBudget budget(timeBudgetSeconds, stepBudget, cancellationToken);
+	fitStats = LatticeFitStats();
+
 	//-----Fit the plane--------------
+	pf.setSeed(ransacSeed);
 	this->planeInlierIdx = pf.ransacFit(pointsInGroup,groupPointsIdx);
     	planeInliersProjected = pf.getProjectedInliers();
 
 	LattStructure.plane = pf.getFittedPlane();
 
+	fitLatticeOnPlane(budget);
+	}
+
+	/*! Method to calculate the lattice end-to-end on a plane that is already known, e.g. from MultiPlaneExtractor. All points of
+	 * the group are taken as plane inliers, so the group should only contain the points of one (group, plane) pair.
+	 * @param[in] plane the plane of the group's points
+	*/
+    void fitLattice(Vector4d const &plane){
+
+	SearchBudget budget(timeBudgetSeconds, stepBudget, cancellationToken);
+	fitStats = LatticeFitStats();
+
+	LattStructure.plane = plane / plane.head<3>().norm();
+	this->planeInlierIdx = groupPointsIdx;
+
+	planeInliersProjected.clear();
+	planeInliersProjected.reserve(pointsInGroup.size());
+	for (size_t i = 0; i < pointsInGroup.size(); i++){
+		double dist = LattStructure.plane.head<3>().dot(pointsInGroup[i]) + LattStructure.plane(3);
+		planeInliersProjected.push_back(pointsInGroup[i] - dist*LattStructure.plane.head<3>());
+	}
+
+	fitLatticeOnPlane(budget);
+	}
+
+	/*! Fits the lattice to planeInliersProjected on LattStructure.plane, the second half of fitLattice. */
+    void fitLatticeOnPlane(SearchBudget &budget){
+
     	//-----Fit lattice----------------
 
+    	// no plane, no lattice
+    	if (planeInliersProjected.size() < 3){
+    		finishFitStats(budget);
+    		return;
+    	}
+
     		//.0 initialize the class
     	LattDetector = new LatticeDetector(planeInliersProjected,LattStructure.plane,inpM);
+    	LattDetector->setThreadCount(detectorThreads);
+    	LattDetector->setValidityMode(validityMode);
+    	LattDetector->setTieBreakValidityMode(tieBreakValidityMode);
+    	LattDetector->setBudget(&budget);
       		//.1 calculate candidate basis vectors
-    	vector<Eigen::Vector3d> candidateBasisVecs = LattDetector->calculateCandidateVectors(0);
+    	vector<Eigen::Vector3d> candidateBasisVecs;
+    	if (candidateMode == LatticeDetector::AUTOCORRELATION_CANDIDATES)
+    		candidateBasisVecs = LattDetector->calculateAutocorrelationCandidateVectors();
+    	else
+    		candidateBasisVecs = LattDetector->calculateCandidateVectors(0);
+
+    	fitStats.candidateVectors = candidateBasisVecs.size();
 
     	//dont attempt to fit a lattice if basis vectors are too many or too few
     	if ((candidateBasisVecs.size() < 2)|| (candidateBasisVecs.size() >
-    	planeInlierIdx.size()*planeInlierIdx.size()/2 ))
+    	planeInlierIdx.size()*planeInlierIdx.size()/2 )){
+    		delete LattDetector;
+    		LattDetector = NULL;
+    		finishFitStats(budget);
     		return;
+    	}
 
     		//.2 calculate final basis vectors
     	LattStructure.basisVectors = LattDetector->getFinalBasisVectors(candidateBasisVecs);
+    	fitStats.partialScores = LattDetector->hasPartialScores();
 
 	// if no two basis vectors found, then dont create  a lattice structure
     	if (LattStructure.basisVectors.size() == 2){
@@ -149,6 +325,21 @@ public:
     	delete LattDetector;
     	LattDetector = NULL;
 
+    	finishFitStats(budget);
+	}
+
+	/*! Fills in fitStats from the budget of a finished fit, and reports early stops. */
+	void finishFitStats(SearchBudget &budget){
+		fitStats.seconds = budget.elapsedSeconds();
+		fitStats.validatedGridPoints = budget.getSteps();
+		fitStats.stopReason = budget.getStopReason();
+
+		if (fitStats.stopReason != SearchBudget::NOT_STOPPED){
+			cout << "lattice search stopped early (" << (fitStats.stopReason == SearchBudget::CANCELLED ? "cancelled" :
+					(fitStats.stopReason == SearchBudget::TIME_BUDGET ? "time budget" : "step budget")) << ") after "
+					<< fitStats.seconds << "s and " << fitStats.validatedGridPoints << " validated grid points"
+					<< (fitStats.partialScores ? ", candidate vectors scored on part of the reference points" : "") << endl;
+		}
 	}
 
 
@@ -162,6 +353,7 @@ public:
 		ofstream os;
 
 		os.open(file,ios::out);
+		os << setprecision(17);	// loading gives back the same doubles
 
 		if (LattStructure.basisVectors.size() != 2)
 		{
@@ -193,10 +385,10 @@ public:
 		os << indicesCount << endl;
 
 		for (int i = 0; i < indicesCount; i++){
-			pair<int,vector<int> > gridIndex = latticeGridIndices[i];
-			os << gridIndex.first << endl;
-			os << gridIndex.second[0] << endl;
-			os << gridIndex.second[1] << endl;
+			LatticeGridIndex const &gridIndex = latticeGridIndices[i];
+			os << gridIndex.pointId << endl;
+			os << gridIndex.i << endl;
+			os << gridIndex.j << endl;
 		}
 
 		os.close();
@@ -214,7 +406,7 @@ public:
 		is.open(file);
 
 		this->LattStructure = LatticeStructure();
-		this->LattStructure.basisVectors = vector<Vector3d>();
+		this->LattStructure.basisVectors.clear();
 
 		double x,y,z,w;
 
@@ -242,21 +434,22 @@ public:
 		is >> w;
 		this->LattStructure.plane = Vector4d(x,y,z,w);
 
-		this->latticeGridIndices = vector<pair<int,vector<int> > >();
+		this->latticeGridIndices = vector<LatticeGridIndex>();
 
 		int indicesCount;
 
 		is >> indicesCount;
 
+		this->latticeGridIndices.reserve(std::max(indicesCount, 0));
+
 		for (int i = 0; i < indicesCount; i++){
-			pair<int,vector<int> > gridIndex = pair<int, vector<int> >();
-			is >> gridIndex.first;
-			gridIndex.second = vector<int>();
+			LatticeGridIndex gridIndex;
+			is >> gridIndex.pointId;
 			int width, height;
 			is >> width;
 			is >> height;
-			gridIndex.second.push_back(width);
-			gridIndex.second.push_back(height);
+			gridIndex.i = width;
+			gridIndex.j = height;
 
 			this->latticeGridIndices.push_back(gridIndex);
 		}
@@ -265,92 +458,51 @@ public:
 	}
 
 	float calculateReprojectionError(){
-		Vector2f pa;
-		CameraMatrix cam;
-		cam.setIntrinsic(inpM->getK());
-
-		float reprojectionError = 0;
-		for (int p=0; p < this->groupPointsIdx.size(); p++){
-			int pointidx  = groupPointsIdx[p];
-
-			for (int j=0; j<inpM->getPointModel()[pointidx].measurements.size();j++){
-				int imgview = inpM->getPointModel()[pointidx].measurements[j].view;
-
-				int i=0;
-				for (i=0;i<inpM->getCamPoses().size();i++){
-					if (inpM->getViewIds()[i] == imgview)
-						break;
-				}
-				Eigen::Matrix<double,3,4> P = inpM->getCamPoses()[i];
-				cam.setOrientation(P);
-				pa = cam.projectPoint(inpM->getPointModel()[pointidx].pos).cast<float>();
-
-				reprojectionError += (pa - inpM->getPointModel()[pointidx].measurements[j].pos).norm();
-			}
-		}
-
-		return reprojectionError;
+		return inpM->reprojectionError(this->groupPointsIdx);
 	}
 
-	/*! Static method to project multiple lattices to an image, for visualization. */
+	/*! Static method to project multiple lattices to an image, for visualization. Opens a window, see OverlayRenderer to write the overlays to files. */
 	static void projectMultipleLatticesToImage(inputManager inpM, vector<LatticeClass> lattices){
-		CameraMatrix cam;
-		cam.setIntrinsic(inpM.getK());
-
+#ifdef LATT_HEADLESS
+		cout << "no display in headless builds, use OverlayRenderer" << endl;
+		return;
+#endif
 		//selects the 1st image that the 1st point is visible
 		int pointidx  = lattices[0].groupPointsIdx[0];
-		int imgview = inpM.getPointModel()[pointidx].measurements[0].view;
+		int imgview = inpM.pointModel[pointidx].measurements[0].view;
 		string img = inpM.getImgNames()[imgview];
-		int i=0;
-		for (i=0;i<inpM.getCamPoses().size();i++){
-			if (inpM.getViewIds()[i] == imgview)
-				break;
-		}
 
-		Eigen::Matrix<double,3,4> P = inpM.getCamPoses()[i];
+		shared_ptr<CameraRig const> rig = inpM.getCameraRig();
+		int camera = rig->cameraOfView(imgview);
+
 		//float const w = 1696;
 		//float const h = 1132;
 		cimg_library::CImg<unsigned char> image(("data/"+img).c_str());
 		const unsigned char color[] = { 0,0,255 };
 
-		cam.setOrientation(P);
-
 		Vector2d pa2d, pb2d;
+		double depth;
 
 		for (vector<LatticeClass>::const_iterator latt = lattices.begin(); latt != lattices.end(); latt++){
-			Vector3d basis1 = (*latt).LattStructure.basisVectors[0];
-			Vector3d basis2 = (*latt).LattStructure.basisVectors[1];
+			// the line endpoints are projected with the homography of the grid into the camera
+			GridHomography const &homography = (*latt).getGridHomographies()->cameras()[camera];
 
 			int k1 = (*latt).LattStructure.width;
 			int k2 = (*latt).LattStructure.height;
 
-			Vector3d B1 = (*latt).LattStructure.corner + k1*basis1;
-			Vector3d B2 = (*latt).LattStructure.corner + k2*basis2;
-
-			Vector3d pa; pa = (*latt).LattStructure.corner;
-			Vector3d pb; pb = B1;
 			for (int k=0; k<=k2; k++){
-				//project pa, pb into image
-				pa2d = cam.projectPoint(pa);
-				pb2d = cam.projectPoint(pb);
+				//project the ends of row k into image
+				pa2d = homography.project(0, k, depth);
+				pb2d = homography.project(k1, k, depth);
 				//plot 2D line into image
 				image.draw_line(pa2d[0],pa2d[1],pb2d[0],pb2d[1],color);
-
-				pa += basis2;
-				pb += basis2;
-
 			}
-			pa = (*latt).LattStructure.corner;
-			pb = B2;
 			for (int k=0; k<=k1; k++){
-				//project pa, pb into image
-				pa2d = cam.projectPoint(pa);
-				pb2d = cam.projectPoint(pb);
+				//project the ends of column k into image
+				pa2d = homography.project(k, 0, depth);
+				pb2d = homography.project(k, k2, depth);
 				//plot 2D line into image
 				image.draw_line(pa2d[0],pa2d[1],pb2d[0],pb2d[1],color);
-
-				pa += basis1;
-				pb += basis1;
 			}
 
 		}
@@ -363,68 +515,56 @@ public:
 
 	}
 
-	/*! Method to project the currect lattice to an image. */
+	/*! Method to project the currect lattice to an image. Opens a window, see OverlayRenderer to write the overlays to files. */
 	void projectLatticeToImage(bool debug = false){
+#ifdef LATT_HEADLESS
+		cout << "no display in headless builds, use OverlayRenderer" << endl;
+		return;
+#endif
 
 		LatticeStructure latt = this->LattStructure;
-		Vector3d basis1 = latt.basisVectors[0];
-		Vector3d basis2 = latt.basisVectors[1];
 
 		int k1 = latt.width;
 		int k2 = latt.height;
 
-		Vector3d B1 = latt.corner + k1*basis1;
-		Vector3d B2 = latt.corner + k2*basis2;
-
-		CameraMatrix cam;
-		cam.setIntrinsic(inpM->getK());
-
-
 		//selects the 1st image that the 1st point is visible
 		int pointidx  = groupPointsIdx[0];
-		int imgview = inpM->getPointModel()[pointidx].measurements[0].view;
+		int imgview = inpM->pointModel[pointidx].measurements[0].view;
 		string img = inpM->getImgNames()[imgview];
-		int i=0;
-		for (i=0;i<inpM->getCamPoses().size();i++){
-			if (inpM->getViewIds()[i] == imgview)
-				break;
-		}
 
-		Eigen::Matrix<double,3,4> P = inpM->getCamPoses()[i];
+		shared_ptr<CameraRig const> rig = inpM->getCameraRig();
+		int camera = rig->cameraOfView(imgview);
+		CameraMatrix const &cam = rig->camera(camera);
+
+		// the line endpoints are projected with the homography of the grid into the camera
+		GridHomography const &homography = getGridHomographies()->cameras()[camera];
+		double depth;
+
 		//float const w = 1696;
 		//float const h = 1132;
 		cimg_library::CImg<unsigned char> image(("data/"+img).c_str());
 		const unsigned char color[] = { 0,0,255 };
 
-		cam.setOrientation(P);
 		Vector2d pa2d, pb2d;
 
 		for (size_t k=0; k < this->pointsInGroup.size(); k++){
-			pa2d = cam.projectPoint(inpM->getPointModel()[groupPointsIdx[k]].pos);//.cast<float>();
+			pa2d = cam.projectPoint(inpM->pointModel[groupPointsIdx[k]].pos);//.cast<float>();
 			//pa2d = cam.projectPoint(group[k]).cast<float>();
 			image.draw_circle(float(pa2d[0]),float(pa2d[1]),4,color,1);
 
 		}
 
-		Vector3d pa; pa = latt.corner;
-		Vector3d pb; pb = B1;
 		for (int k=0; k<=k2; k++){
-			//project pa, pb into image
-			pa2d = cam.projectPoint(pa);
-			pb2d = cam.projectPoint(pb);
+			//project the ends of row k into image
+			pa2d = homography.project(0, k, depth);
+			pb2d = homography.project(k1, k, depth);
 			//plot 2D line into image
 			image.draw_line(pa2d[0],pa2d[1],pb2d[0],pb2d[1],color);
-
-			pa += basis2;
-			pb += basis2;
-
 		}
-		pa = latt.corner;
-		pb = B2;
 		for (int k=0; k<=k1; k++){
-			//project pa, pb into image
-			pa2d = cam.projectPoint(pa);
-			pb2d = cam.projectPoint(pb);
+			//project the ends of column k into image
+			pa2d = homography.project(k, 0, depth);
+			pb2d = homography.project(k, k2, depth);
 			//plot 2D line into image
 			image.draw_line(pa2d[0],pa2d[1],pb2d[0],pb2d[1],color);
 
@@ -434,13 +574,11 @@ public:
 					image.draw_circle(pa2d[0],pa2d[1],6,c,1);
 				}
 			}
-			pa += basis1;
-			pb += basis1;
 		}
 
 		if (debug){
 			for (int j=0; j< this->latticeGridIndices.size();j++){
-				pa2d = cam.projectPoint(inpM->getPointModel()[latticeGridIndices[j].first].pos);
+				pa2d = cam.projectPoint(inpM->pointModel[latticeGridIndices[j].pointId].pos);
 				image.draw_circle(float(pa2d[0]),float(pa2d[1]),2+1*j,color,1);
 			}
 		}
@@ -452,56 +590,51 @@ public:
 			main_disp.wait();
 		}
 	}
-	/*! Method to project the currect group of points to an image. */
+	/*! Method to project the currect group of points to an image. Opens a window per view, see OverlayRenderer to write the overlays to files. */
 	void projectGroupToImage(){
+#ifdef LATT_HEADLESS
+		cout << "no display in headless builds, use OverlayRenderer" << endl;
+		return;
+#endif
 
 		vector<Vector3d> group = this->pointsInGroup;
 
-		CameraMatrix cam;
-		cam.setIntrinsic(inpM->getK());
+		shared_ptr<CameraRig const> rig = inpM->getCameraRig();
 		const unsigned char color[] = { 0,0,255 };
 		const unsigned char color_green[] = { 0,255,0 };
-		Eigen::Matrix<double,3,4> P;
 
 		int pointidx  = groupPointsIdx[0];
 			//get the view id and the respected image name for this point
 			//The m.view refer to the image index
 			// Pose index points to the image index
 
-		for (int kk=0; kk<inpM->getPointModel()[pointidx].measurements.size();kk++){
-			int imgview = inpM->getPointModel()[pointidx].measurements[kk].view;
+		for (int kk=0; kk<inpM->pointModel[pointidx].measurements.size();kk++){
+			int imgview = inpM->pointModel[pointidx].measurements[kk].view;
 
 			string img = inpM->getImgNames()[imgview];
 
-			//get the camera pose for this viewid
-			size_t i = 0;
-			for (i = 0; i < inpM->getCamPoses().size(); i++){
-				if (inpM->getViewIds()[i] == imgview)
-					break;
-			}
-
-			P = inpM->getCamPoses()[i];
+			//get the camera for this viewid
+			CameraMatrix const &cam = rig->camera(rig->cameraOfView(imgview));
 
 			cimg_library::CImg<unsigned char> image(("data/"+img).c_str());
 
-			cam.setOrientation(P);
-
 			Vector2f pa2d;
 			for (size_t k=0; k < group.size(); k++){
-				pa2d = cam.projectPoint(inpM->getPointModel()[groupPointsIdx[k]].pos).cast<float>();
+				TriangulatedPoint const &point = inpM->pointModel[groupPointsIdx[k]];
+				pa2d = cam.projectPoint(point.pos).cast<float>();
 				image.draw_circle(pa2d[0],pa2d[1],5,color,1);
 
 				//draw also nominal position (from SIFT feature)
 				bool found = false;
 				int q = 0;
-				for(q=0; q<inpM->getPointModel()[groupPointsIdx[k]].measurements.size(); q++){
-					if (inpM->getPointModel()[groupPointsIdx[k]].measurements[q].view == imgview){
+				for(q=0; q<point.measurements.size(); q++){
+					if (point.measurements[q].view == imgview){
 						found = true;
 						break;
 					}
 				}
 				if (found){
-					pa2d = inpM->getPointModel()[groupPointsIdx[k]].measurements[q].pos;
+					pa2d = point.measurements[q].pos;
 					image.draw_circle(pa2d[0],pa2d[1],5,color_green,1);
 				}
 			}
@@ -518,13 +651,208 @@ public:
 
 	/*! Method to write the currect lattice to VRML file. */
 	void writeToVRML(const char* filename, const bool append = true){
-		writeLatticeToVRML(this->LattStructure.plane,this->LattStructure.basisVectors,
+		writeLatticeToVRML(this->LattStructure.plane,this->LattStructure.basisVectors.toVector(),
 				this->LattStructure.corner,this->LattStructure.width,this->LattStructure.height,
 				filename, append);
 	}
 
 
-	int densifyStructure(int start_index){
+	/*!< struct for a lattice grid cell without a 3d point, and the view it is added with */
+	struct DensifyingCell
+	{
+		int i, j;			/*!< Grid coordinates of the cell. */
+		Vector3d pos;		/*!< 3d position of the grid point. */
+		int bestView;		/*!< The most frontoparallel view that sees the grid point. */
+		Vector2d pixel;		/*!< The projection of the grid point into that view. */
+	};
+
+	/*!
+	 * Returns the homographies from grid coordinates (i,j) to pixels in all cameras (see GridHomographies). They are computed on the
+	 * first call and recomputed only after the lattice structure or the cameras changed. The lattice must have two basis vectors.
+	 * Safe to call concurrently.
+	 */
+	shared_ptr<GridHomographies const> getGridHomographies() const{
+		shared_ptr<CameraRig const> rig = inpM->getCameraRig();
+
+		shared_ptr<GridHomographies const> cached = atomic_load(&gridHomographies);
+		if (!cached || !cached->matches(LattStructure, rig.get())){
+			cached = make_shared<GridHomographies const>(LattStructure, rig);
+			atomic_store(&gridHomographies, cached);
+		}
+		return cached;
+	}
+
+	/*!
+	 * Finds the lattice grid cells without a 3d point, and for each of them the most frontoparallel view that sees it.
+	 * The existing cells are looked up in a hash set, and the views are selected for all missing cells at once, one camera at a time.
+	 * No images are loaded apart from the (cached) image sizes, so it may run for several lattices in parallel.
+	 *
+	 * @return	The missing cells, by increasing i and then j. Cells that no view sees are left out.
+	 */
+	vector<DensifyingCell> findDensifyingCells() const{
+
+		vector<DensifyingCell> cells;
+		if (LattStructure.basisVectors.size() != 2){
+			return cells;
+		}
+
+		unordered_set<long long> existing;
+		existing.reserve(latticeGridIndices.size());
+		for (size_t k = 0; k < latticeGridIndices.size(); k++){
+			existing.insert(cellKey(latticeGridIndices[k].i, latticeGridIndices[k].j));
+		}
+
+		vector<pair<int,int> > missing;
+		for (int i = 0; i <= LattStructure.width; i++){
+			for (int j = 0; j <= LattStructure.height; j++){
+				if (existing.count(cellKey(i, j)) == 0){
+					missing.push_back(make_pair(i, j));
+				}
+			}
+		}
+
+		int n = missing.size();
+		if (n == 0){
+			return cells;
+		}
+
+		Matrix<double,2,Dynamic> ij(2, n);
+		for (int c = 0; c < n; c++){
+			ij.col(c) << missing[c].first, missing[c].second;
+		}
+
+		Matrix<double,3,2> basis;
+		basis << LattStructure.basisVectors[0], LattStructure.basisVectors[1];
+
+		Vector3d normal = LattStructure.plane.head<3>();
+		ArrayXd bestCosangle = ArrayXd::Zero(n);
+		vector<int> bestView(n, -1);
+		Matrix<double,2,Dynamic> bestPixel = Matrix<double,2,Dynamic>::Zero(2, n);
+
+		// the grid points are projected with the homography of the grid into every camera, no 3d positions needed
+		vector<GridHomography> const &homographies = getGridHomographies()->cameras();
+
+		for (size_t v = 0; v < homographies.size(); v++){
+			//get view
+			int view = homographies[v].view;
+
+			if ((view < 45) || (view > 47)){
+				continue;
+			}
+
+			int w, h;
+			if (!inpM->getImageSize(view, w, h)){
+				continue;
+			}
+
+			//angle between camera-point line and plane normal, abs because we dont know the plane orientation
+			Matrix<double,3,Dynamic> lines = (basis*ij).colwise() + homographies[v].cornerOffset;
+			ArrayXd cosangle = (normal.transpose()*lines).array().abs().transpose() / (lines.colwise().norm().array().transpose()*normal.norm());
+
+			//project all points into the image
+			Matrix<double,2,Dynamic> pixels;
+			ArrayXd depth;
+			homographies[v].project(ij, pixels, depth);
+
+			for (int c = 0; c < n; c++){
+				double x = pixels(0,c);
+				double y = pixels(1,c);
+				if ((depth(c) > 0) && (cosangle(c) > bestCosangle(c)) && (x >= 0) && (y >= 0) && (x < w) && (y < h)){
+					bestCosangle(c) = cosangle(c);
+					bestView[c] = view;
+					bestPixel.col(c) << x, y;
+				}
+			}
+		}
+
+		for (int c = 0; c < n; c++){
+			if (bestView[c] < 0){
+				continue;
+			}
+			DensifyingCell cell;
+			cell.i = missing[c].first;
+			cell.j = missing[c].second;
+			cell.pos = LattStructure.corner + basis*ij.col(c);
+			cell.bestView = bestView[c];
+			cell.pixel = bestPixel.col(c);
+			cells.push_back(cell);
+		}
+
+		return cells;
+	}
+
+	/*!
+	 * Adds the grid points of missing cells as densifying points, with their best view as only measurement, and numbers them.
+	 *
+	 * @param[in] cells			The missing cells, see findDensifyingCells().
+	 * @param[in] start_index	The index of the first added point in the pointModel.
+	 * @return	The number of added points.
+	 */
+	int addDensifyingCells(vector<DensifyingCell> const &cells, int start_index){
+
+		for (size_t c = 0; c < cells.size(); c++){
+
+			// add most frontoparallel view as only measurement
+			vector<PointMeasurement> ms;
+			Eigen::Vector2f p2f;
+			p2f << cells[c].pixel(0), cells[c].pixel(1);
+			PointMeasurement newMeasurement(p2f,cells[c].bestView);
+			ms.push_back(newMeasurement);
+
+			// add new point to densifying points container
+			TriangulatedPoint newPoint(cells[c].pos,ms);
+			densifyingPoints.push_back(newPoint);
+
+			// update lattice grid indices
+			LatticeGridIndex newPointPair;
+			newPointPair.pointId = start_index+c;
+			newPointPair.i = cells[c].i;
+			newPointPair.j = cells[c].j;
+
+			densifyingLatticeGridIndices.push_back(newPointPair);
+			latticeGridIndices.push_back(newPointPair);
+		}
+
+		return cells.size();
+	}
+
+	/*!
+	 * Densifies several lattices (see densifyStructure). The missing cells and their views are found for all lattices in parallel,
+	 * the new points are then numbered serially, in the order of the lattices, so the indices are the same as in a serial run.
+	 *
+	 * @param[in,out] lattices	The lattices to densify.
+	 * @param[in] start_index	The index of the first added point in the pointModel.
+	 * @return	The end index of the added points, or -1 if a lattice failed.
+	 */
+	static int densifyStructures(vector<LatticeClass> &lattices, int start_index){
+
+		vector<vector<DensifyingCell> > cells(lattices.size());
+		parallelFor(lattices.size(), [&](int l){
+			if (lattices[l].computeDensifyingPoints){
+				cells[l] = lattices[l].findDensifyingCells();
+			}
+		});
+
+		int index = start_index;
+		for (size_t l = 0; l < lattices.size(); l++){
+			index = lattices[l].densifyStructure(index, &cells[l]);
+			if (index < 0){
+				return -1;
+			}
+		}
+
+		return index;
+	}
+
+	/*!
+	 * Adds the missing grid points of the lattice as new 3d points (densifyingPoints), each with its most frontoparallel view as measurement,
+	 * and saves them to densifyingPointsFile, or reads them from there if computeDensifyingPoints is false.
+	 *
+	 * @param[in] start_index	The index of the first added point in the pointModel.
+	 * @param[in] precomputedCells	The result of findDensifyingCells(), if it was already computed. NULL to compute it.
+	 * @return	The end index of the added points (last index used+1), or -1 if a file could not be opened.
+	 */
+	int densifyStructure(int start_index, vector<DensifyingCell> const *precomputedCells = NULL){
 
 		int new_point_count = 0;            // counter variable to handle indexing
 
@@ -535,137 +863,16 @@ public:
 
 		if(computeDensifyingPoints)
 		{
-
-			// loop through lattice structure and look for missing points
-			for(size_t i = 0; i<=LattStructure.width; i+=1)               // gridpoint horizontal coordinate
-			{
-				for(size_t j = 0; j<=LattStructure.height; j+=1)          // gridpoint vertical coordinates
-				{
-					bool point_exists = false;
-
-					cout << "Checking lattice grid point (" << i << "," << j << ")" << " : " << endl;
-					for(size_t k = 0; k<latticeGridIndices.size(); k+=1)
-					{
-						// check if a point already exists for the given grid point
-						if(latticeGridIndices[k].second[0] == i && latticeGridIndices[k].second[1] == j)
-						{
-							cout << "3d point already exists." << endl;
-							point_exists = true;
-						}
-					}
-					if(!point_exists)
-					{
-						cout << "adding new 3d point with views "<< endl;
-
-						Eigen::Vector3d pos;
-						pos = LattStructure.corner
-								+i*LattStructure.basisVectors[0]
-								+j*LattStructure.basisVectors[1];
-
-						// add most frontoparallel view as only measurement
-						CameraMatrix cam;
-						cam.setIntrinsic(inpM->getK());
-
-						vector<PointMeasurement> ms;
-						double cosangle = 0;
-						double tmpcosangle=0;
-						int bestview=-1;
-						Vector4d plane = LattStructure.plane;
-						Vector2d pbest(0,0);
-						Vector2d p;
-
-						for(size_t i=0; i<inpM->getCamPoses().size(); i++)
-						{
-							//get view
-							int view = inpM->getViewIds()[i];
-
-							if ((view < 45) || (view > 47))
-							{
-								continue;
-							}
-
-							string img = inpM->getImgNames()[view];
-							cimg_library::CImg<unsigned char> image(("data/"+img).c_str());
-							float const w = image.width();
-							float const h = image.height();
-
-							//check angle between camera-point line and plane normal
-							Vector3d line = pos - inpM->getCamPoses()[i].block<3,1>(0,3);
-							//abs because we dont know the plane orientation
-							tmpcosangle = abs(line.dot(plane.head(3)))/sqrt(line.squaredNorm() * plane.head(3).squaredNorm());
-
-							//project point into image
-							cam.setOrientation(inpM->getCamPoses()[i]);
-							p = cam.projectPoint(pos);
-
-							double d = cam.transformPointIntoCameraSpace(pos)[2];
-
-							if ((d > 0) && (tmpcosangle > cosangle) && (p[0]>=0)&&(p[1]>=0)&& (p[0]<w)&&(p[1]<h)){
-								cosangle = tmpcosangle;
-								bestview = view;
-								pbest = p;
-								//if ( abs(cosangle) > 0.9)
-								//	break;
-							   }
-						}
-
-						// bestview ist the one we add as measurement
-						string img = inpM->getImgNames()[bestview];
-						cimg_library::CImg<unsigned char> image(("data/"+img).c_str());
-
-						/*
-						int bestViewIndex;
-						for(int l = 0; l<inpM->getViewIds().size(); l++)
-						{
-							if(inpM->getViewIds()[l] == bestview)
-								bestViewIndex = l;
-						}
-
-						cam.setOrientation(inpM->getCamPoses()[bestViewIndex]);
-						p = cam.projectPoint(pos);
-
-
-						const unsigned char color[] = { 0,0,255 };
-						image.draw_circle(p[0],p[1],5,color,1);
-
-						cimg_library::CImgDisplay main_disp(image,"");
-
-						while (!main_disp.is_closed()){
-							main_disp.wait(500);
-						}
-						*/
-
-						Eigen::Vector2f p2f;
-						p2f << p(0), p(1);
-						PointMeasurement newMeasurement(p2f,bestview);
-						ms.push_back(newMeasurement);
-
-						// add new point to densifying points container
-						TriangulatedPoint newPoint(pos,ms);
-						densifyingPoints.push_back(newPoint);
-
-						// update lattice grid indices
-						vector<int> gridPosition;
-						pair<int,vector<int> > newPointPair;
-
-						gridPosition.push_back(i);
-						gridPosition.push_back(j);
-						newPointPair.first = start_index+new_point_count;
-						newPointPair.second = gridPosition;
-
-						densifyingLatticeGridIndices.push_back(newPointPair);
-						latticeGridIndices.push_back(newPointPair);
-
-						new_point_count++;
-
-					}
-				} // end vertical search of grid points
-			} // end horizontal search of grid points
+			if (precomputedCells != NULL)
+				new_point_count = addDensifyingCells(*precomputedCells, start_index);
+			else
+				new_point_count = addDensifyingCells(findDensifyingCells(), start_index);
 
 			// save densifying points to separate file
 			ofstream os(densifyingPointsFile);
 			if(!os.good())
 			{
+				cout.rdbuf(old);
 				cout << "Problem opening filestream for saving densifying points" << endl;
 				return -1;
 			}
@@ -699,6 +906,7 @@ public:
 			ofstream os2(densifyingPointsIndicesFile);
 			if(!os2.good())
 			{
+				cout.rdbuf(old);
 				cout << "Problem opening filestream for saving densifying points indices" << endl;
 				return -1;
 			}
@@ -711,11 +919,11 @@ public:
 			for (size_t i = 0; i<densifyingLatticeGridIndices.size(); i++)
 			{
 				// output index of 3d point corresponding to grid point
-				os2 << densifyingLatticeGridIndices[i].first << " ";
+				os2 << densifyingLatticeGridIndices[i].pointId << " ";
 
 				// output grid coordinates
-				os2 << densifyingLatticeGridIndices[i].second[0] << " ";
-				os2 << densifyingLatticeGridIndices[i].second[1] << endl;
+				os2 << densifyingLatticeGridIndices[i].i << " ";
+				os2 << densifyingLatticeGridIndices[i].j << endl;
 			}
 			os2.close();
 
@@ -727,6 +935,7 @@ public:
 			ifstream is(densifyingPointsFile);
 			if(!is.good())
 			{
+				cout.rdbuf(old);
 				cout << "Problem opening file to read densifying points from" << endl;
 				return -1;
 			}
@@ -767,6 +976,7 @@ public:
 			ifstream is2(densifyingPointsIndicesFile);
 			if(!is2.good())
 			{
+				cout.rdbuf(old);
 				cout << "Problem opening file to read densifying points indices from file" << endl;
 				return -1;
 			}
@@ -778,20 +988,17 @@ public:
 				//read information to fill lattGridIndices
 				is2 >> index >> pos_x >> pos_y;
 
-				vector<int> gridPosition;
-				pair<int,vector<int> > newPointPair;
-
-				gridPosition.push_back(pos_x);
-				gridPosition.push_back(pos_y);
-				newPointPair.first = start_index+new_point_count;
-				newPointPair.second = gridPosition;
+				LatticeGridIndex newPointPair;
+				newPointPair.pointId = start_index+new_point_count;
+				newPointPair.i = pos_x;
+				newPointPair.j = pos_y;
 
 				new_point_count++;
 
 				densifyingLatticeGridIndices.push_back(newPointPair);
 				latticeGridIndices.push_back(newPointPair);
 
-				cout << "Read latticeGridIndices ( " << pos_x <<  "," << pos_y << ") with 3dpoint index" << newPointPair.first << endl;
+				cout << "Read latticeGridIndices ( " << pos_x <<  "," << pos_y << ") with 3dpoint index" << newPointPair.pointId << endl;
 			}
 			is2.close();
 
@@ -812,6 +1019,11 @@ public:
 		return end_index;       // returns end index of added points in pointModel container.
 	}
 
+	/*! Returns the hash key of grid cell (i,j). */
+	static long long cellKey(int i, int j){
+		return ((long long)i << 32) ^ (long long)(unsigned int)j;
+	}
+
 	// *** HELPER FUNCTIONS TO CONSOLIDATE LATTICES
 
 	/*!
@@ -859,82 +1071,75 @@ public:
 	}
 
 	/*!
-	 * Consolidates / merges similar lattices together
+	 * Calculates the hash key of a lattice's basis for consolidation, and the keys of the neighbouring cells. The basis is brought to a
+	 * canonical form that does not depend on the order and orientation of its vectors (the 8 transformations of calculateLatticeTransformation):
+	 * the log lengths of the shorter and the longer vector, and the absolute cosine of their angle. These are quantized into cells that are
+	 * wider than the change similar lattices can have (a vector within TRESHOLD1 of another one differs by less than log(1/(1-TRESHOLD1))
+	 * in log length, and by less than asin(TRESHOLD1) in direction). So similar lattices are always in the same or in neighbouring cells.
 	 *
-	 * @param[in] The lattices to consolidate
-	 * @return	A list of consolidated lattice groups, each group consisting of a list of similar lattices that have their
-	 * 			consolidationTransformation field set to monitor the similarity between the group members properly
+	 * @param[in] lattice	The lattice.
+	 * @param[out] neighbourKeys	The keys of the lattice's cell and the 26 cells around it.
+	 * @return	The key of the lattice's cell, -1 if the lattice has no two nonzero basis vectors.
 	 */
-	static list<list<LatticeClass> > consolidateLattices(vector<LatticeClass> const &lattices){
-
-		std::vector<LatticeClass>::const_iterator latticeIt;
-		std::list<list<LatticeClass> >::iterator clusterItOuter;
-		std::list<LatticeClass>::iterator clusterItInner;
-
-		list<list<LatticeClass> > clusteredLattices = list<list<LatticeClass> >(0);
-
-		for(latticeIt = lattices.begin(); latticeIt != lattices.end(); ++latticeIt){
+	static long long consolidationKey(LatticeClass const &lattice, vector<long long> &neighbourKeys){
+		neighbourKeys.clear();
 
-			// Make a new cluster for the lattice
-			list<LatticeClass> cluster = list<LatticeClass>();
-			LatticeClass lattice = (*latticeIt);
-			lattice.consolidationTransformation = 0;
-			cluster.push_back(lattice);
-
-			for (clusterItOuter = clusteredLattices.begin(); clusterItOuter!=clusteredLattices.end();){ // iterator is increased manually!
-
-				bool inCluster = false;
-
-				int transLToO;
-				int transLToOPrime;
-				// Search all the lattices in the current cluster. If one of them is similar to the candidate lattice,
-				// the current cluster shall be merged into the candidate's cluster.
-				// Note: More than one existing cluster can be merged into the newly formed cluster.
-
-				// The candidate O in the new cluster is the new "origin" in terms of transformations.
-				// All lattices L' in the cluster have saved a transformation wrt. their old origin O' (L' -> O')
-				// From the lattice L that matched O, we compute a transformation O' -> O by concatenating the transformations
-				// O' -> L and L -> O. Then for every lattice L' in the cluster, we compute L' -> O via L' -> O' and O' -> O
-
-				for(clusterItInner = (*clusterItOuter).begin(); clusterItInner != (*clusterItOuter).end(); ++clusterItInner){
-					transLToO = calculateLatticeTransformation((*latticeIt), (*clusterItInner));
-					if (transLToO >= 0){
-						transLToOPrime = clusterItInner->consolidationTransformation;
-						inCluster = true;
-						break;
-					}
-				}
-				if (inCluster){
-
-					// change transformations L' -> O' to L' -> O
+		if (lattice.LattStructure.basisVectors.size() != 2){
+			return -1;
+		}
+		Vector3d vector0 = lattice.LattStructure.basisVectors[0];
+		Vector3d vector1 = lattice.LattStructure.basisVectors[1];
+		double norm0 = vector0.norm();
+		double norm1 = vector1.norm();
+		if ((norm0 == 0) || (norm1 == 0)){
+			return -1;
+		}
 
-					int transOPrimeToL = revertTransformation(transLToOPrime);
-					int transOPrimeToO = concatenateTransformations(transOPrimeToL, transLToO);
+		double logLengthCell = -log(1 - LatticeDetector::TRESHOLD1) * 1.05;
+		double cosineCell = 2 * asin(LatticeDetector::TRESHOLD1) * 1.05;
 
-					for(clusterItInner = (*clusterItOuter).begin(); clusterItInner != (*clusterItOuter).end(); ++clusterItInner){
-						int transLPrimeToOPrime = clusterItInner->consolidationTransformation;
-						int transLPrimeToO = concatenateTransformations(transLPrimeToOPrime, transOPrimeToO);
-						clusterItInner->consolidationTransformation = transLPrimeToO;
-					}
+		int cell[3];
+		cell[0] = (int)floor(log(std::min(norm0, norm1)) / logLengthCell);
+		cell[1] = (int)floor(log(std::max(norm0, norm1)) / logLengthCell);
+		cell[2] = (int)floor(fabs(vector0.dot(vector1)) / (norm0*norm1) / cosineCell);
 
-					// Merge the old cluster into the new cluster
-					cluster.splice(cluster.end(), *clusterItOuter);
-					// Remove the old cluster from the list. Advances iterator automatically.
-					clusterItOuter=clusteredLattices.erase(clusterItOuter);
-				}
-				else{
-					// increase iterator
-					++clusterItOuter;
+		for (int d0 = -1; d0 <= 1; d0++){
+			for (int d1 = -1; d1 <= 1; d1++){
+				for (int d2 = -1; d2 <= 1; d2++){
+					neighbourKeys.push_back(consolidationCellKey(cell[0]+d0, cell[1]+d1, cell[2]+d2));
 				}
 			}
-
-			// append the new cluster to the list
-			clusteredLattices.push_back(cluster);
 		}
 
-		return clusteredLattices;
+		return consolidationCellKey(cell[0], cell[1], cell[2]);
+	}
+
+	/*! Returns the hash key of consolidation cell (c0,c1,c2), 21 bits per coordinate. */
+	static long long consolidationCellKey(int c0, int c1, int c2){
+		return (((long long)c0 & 0x1FFFFF) << 42) | (((long long)c1 & 0x1FFFFF) << 21) | ((long long)c2 & 0x1FFFFF);
 	}
 
+	/*!
+	 * Consolidates / merges similar lattices together
+	 * Similar lattices are only searched among the lattices whose canonical basis is in a neighbouring hash cell (see consolidationKey), and
+	 * confirmed with calculateLatticeTransformation. The clusters, their order and the transformations are the same as when comparing every
+	 * lattice with every cluster member: a new lattice O merges all clusters with a member similar to it, and the transformations L' -> O' of
+	 * a merged cluster are changed to L' -> O through its first member L that is similar to O. The lattices are only copied into the result.
+	 *
+	 * @param[in] The lattices to consolidate
+	 * @return	The consolidated lattice groups, stored flat (see ConsolidatedLattices), each group consisting of similar lattices that have
+	 * 			their consolidationTransformation field set to monitor the similarity between the group members properly
+	 */
+	static ConsolidatedLattices consolidateLattices(vector<LatticeClass> const &lattices);
+
+	/*!
+	 * Consolidates / merges similar lattices together, see above. The lattices are moved into the result instead of copied.
+	 *
+	 * @param[in] The lattices to consolidate, left empty
+	 * @return	The consolidated lattice groups
+	 */
+	static ConsolidatedLattices consolidateLattices(vector<LatticeClass> &&lattices);
+
 	/*!
 	 * Calculates the lattice transformation from lattice2 -> lattice1, if they are similar.
 	 * If the lattices are similar, the return value corresponds to the transformation, otherwise the return value is -1.
@@ -1006,6 +1211,134 @@ public:
 
 };
 
+/*!< struct for consolidated lattice groups, stored flat: the lattices of group g are lattices[groupBegin(g)] to lattices[groupEnd(g)-1] */
+struct ConsolidatedLattices
+{
+	vector<LatticeClass> lattices;	/*!< The lattices of all groups, group after group. */
+	vector<int> groupOffsets;		/*!< Index of the first lattice of every group, followed by lattices.size(). Empty if there are no groups. */
+
+	/*! Returns the number of groups. */
+	int groupCount() const{
+		return groupOffsets.empty() ? 0 : groupOffsets.size() - 1;
+	}
+
+	/*! Returns the index of the first lattice of group g. */
+	int groupBegin(int g) const{
+		return groupOffsets[g];
+	}
+
+	/*! Returns the index after the last lattice of group g. */
+	int groupEnd(int g) const{
+		return groupOffsets[g+1];
+	}
+
+	/*! Returns the number of lattices of group g. */
+	int groupSize(int g) const{
+		return groupOffsets[g+1] - groupOffsets[g];
+	}
+};
+
+inline ConsolidatedLattices LatticeClass::consolidateLattices(vector<LatticeClass> const &lattices){
+	vector<LatticeClass> copies(lattices);
+	return consolidateLattices(std::move(copies));
+}
+
+inline ConsolidatedLattices LatticeClass::consolidateLattices(vector<LatticeClass> &&lattices){
+
+	int n = lattices.size();
+
+	vector<int> transformation(n, 0);			// L -> O, O being the newest lattice of L's cluster
+	vector<int> clusterOf(n, -1);				// a cluster is named after the lattice that created it
+	vector<vector<int> > clusterMembers(n);		// members of every cluster, in order. Empty once merged into a newer cluster.
+
+	unordered_map<long long, vector<int> > buckets;
+	vector<long long> neighbourKeys;
+
+	for (int i = 0; i < n; i++){
+
+		// Make a new cluster for the lattice
+		clusterOf[i] = i;
+		clusterMembers[i].push_back(i);
+
+		long long key = consolidationKey(lattices[i], neighbourKeys);
+		if (key < 0){
+			continue;
+		}
+
+		// similar lattices so far: transformation L -> O for every similar L
+		unordered_map<int, int> similar;
+		for (size_t k = 0; k < neighbourKeys.size(); k++){
+			unordered_map<long long, vector<int> >::const_iterator bucket = buckets.find(neighbourKeys[k]);
+			if (bucket == buckets.end()){
+				continue;
+			}
+			for (size_t b = 0; b < bucket->second.size(); b++){
+				int j = bucket->second[b];
+				int transLToO = calculateLatticeTransformation(lattices[i], lattices[j]);
+				if (transLToO >= 0){
+					similar[j] = transLToO;
+				}
+			}
+		}
+
+		// the clusters to merge, oldest first
+		vector<int> mergedClusters;
+		for (unordered_map<int, int>::const_iterator it = similar.begin(); it != similar.end(); ++it){
+			mergedClusters.push_back(clusterOf[it->first]);
+		}
+		sort(mergedClusters.begin(), mergedClusters.end());
+		mergedClusters.erase(unique(mergedClusters.begin(), mergedClusters.end()), mergedClusters.end());
+
+		for (size_t c = 0; c < mergedClusters.size(); c++){
+			vector<int> &members = clusterMembers[mergedClusters[c]];
+
+			// the first member L of the cluster that is similar to O
+			int transLToO = 0;
+			int transLToOPrime = 0;
+			for (size_t m = 0; m < members.size(); m++){
+				unordered_map<int, int>::const_iterator match = similar.find(members[m]);
+				if (match != similar.end()){
+					transLToO = match->second;
+					transLToOPrime = transformation[members[m]];
+					break;
+				}
+			}
+
+			// change transformations L' -> O' to L' -> O
+			int transOPrimeToL = revertTransformation(transLToOPrime);
+			int transOPrimeToO = concatenateTransformations(transOPrimeToL, transLToO);
+
+			for (size_t m = 0; m < members.size(); m++){
+				transformation[members[m]] = concatenateTransformations(transformation[members[m]], transOPrimeToO);
+				clusterOf[members[m]] = i;
+			}
+
+			// Merge the old cluster into the new cluster
+			clusterMembers[i].insert(clusterMembers[i].end(), members.begin(), members.end());
+			members.clear();
+		}
+
+		buckets[key].push_back(i);
+	}
+
+	ConsolidatedLattices clusteredLattices;
+	clusteredLattices.lattices.reserve(n);
+
+	for (int c = 0; c < n; c++){
+		if (clusterMembers[c].empty()){
+			continue;
+		}
+		clusteredLattices.groupOffsets.push_back(clusteredLattices.lattices.size());
+		for (size_t m = 0; m < clusterMembers[c].size(); m++){
+			clusteredLattices.lattices.push_back(std::move(lattices[clusterMembers[c][m]]));
+			clusteredLattices.lattices.back().consolidationTransformation = transformation[clusterMembers[c][m]];
+		}
+	}
+	clusteredLattices.groupOffsets.push_back(clusteredLattices.lattices.size());
+
+	return clusteredLattices;
+}
+
 
 
 #endif
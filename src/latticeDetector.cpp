@@ -4,18 +4,82 @@
 #include <numeric>
 #include <math.h>
 #include "3dtools.h"
+#include "fft.h"
+#include "unionFind.h"
+#include "parallel.h"
 
 
 LatticeDetector::LatticeDetector(vector<Vector3d> const &aPoints, Vector4d const &aPlane, inputManager* aInputManager){
 	points = aPoints;
 	plane = aPlane;
 	inpManager = aInputManager;
+	validityMode = SIFT_VALIDATION;
+	tieBreakValidityMode = OCCUPANCY_VALIDATION;
+	budget = NULL;
+	threadCount = 0;
+	partialScores = false;
+
+	Vector3d centroid = Vector3d(0,0,0);
+	for (size_t i = 0; i < points.size(); i++){
+		centroid = centroid + points[i];
+	}
+	if (points.size() > 0){
+		centroid = centroid / points.size();
+	}
+	frame = PlaneFrame(plane, centroid);
+
+	points2d = vector<Vector2d>();
+	points2d.reserve(points.size());
+	for (size_t i = 0; i < points.size(); i++){
+		points2d.push_back(frame.toPlane(points[i]));
+	}
+
+	// the occupancy hash is built with the points, afterwards it is only read (isOccupied needs no lock)
+	occupancyGrid.reserve(points2d.size());
+	for (size_t i = 0; i < points2d.size(); i++){
+		occupancyGrid[gridCellKey((int)floor(points2d[i](0)/OCCUPANCY_TOLERANCE), (int)floor(points2d[i](1)/OCCUPANCY_TOLERANCE))].push_back(i);
+	}
 }
 
 LatticeDetector::~LatticeDetector(){
 
 }
 
+void LatticeDetector::setValidityMode(ValidityMode mode){
+	validityMode = mode;
+}
+
+void LatticeDetector::setTieBreakValidityMode(ValidityMode mode){
+	tieBreakValidityMode = mode;
+}
+
+void LatticeDetector::setBudget(SearchBudget* aBudget){
+	budget = aBudget;
+}
+
+void LatticeDetector::setThreadCount(int aThreadCount){
+	threadCount = aThreadCount;
+}
+
+bool LatticeDetector::hasPartialScores() const{
+	return partialScores;
+}
+
+bool LatticeDetector::budgetExhausted(){
+	return (budget != NULL) && budget->exhausted();
+}
+
+FacadeRectifier const &LatticeDetector::getRectifiedFacade(){
+
+	lock_guard<mutex> lock(rectifierMutex);
+
+	if (!rectifiedFacade){
+		rectifiedFacade.reset(new FacadeRectifier(points, plane, inpManager));
+	}
+
+	return *rectifiedFacade;
+}
+
 Vector3d LatticeDetector::translationVector(Vector3d const &point1, Vector3d const &point2){
 
 	Vector3d translation = point1-point2;
@@ -101,6 +165,246 @@ vector<Vector3d> LatticeDetector::calculateCandidateVectors(bool naive){
 	}
 }
 
+vector<Vector3d> LatticeDetector::calculateAutocorrelationCandidateVectors(){
+
+	PlaneRaster raster;
+
+	if (validityMode == RECTIFIED_VALIDATION && getRectifiedFacade().hasTexture()){
+		raster = rasterizeTexture();
+	}
+	else{
+		raster = rasterizePoints();
+	}
+
+	vector<Vector2d> peaks = autocorrelationPeaks(raster);
+
+	vector<Vector3d> candidates = vector<Vector3d>();
+
+	for (size_t i = 0; i < peaks.size(); i++){
+		Vector3d candidate = raster.frame.directionFromPlane(peaks[i]*raster.pixelSize);
+
+		// same lower bound on the length as for the pairwise candidates
+		if (candidate.norm() > VECTOR_DISTANCE){
+			candidates.push_back(candidate);
+		}
+	}
+
+	return candidates;
+}
+
+LatticeDetector::PlaneRaster LatticeDetector::rasterizeTexture(){
+
+	FacadeRectifier const &facade = getRectifiedFacade();
+	cv::Mat const &texture = facade.getTexture();
+	cv::Mat const &coverage = facade.getCoverage();
+
+	// downsample by block averaging until the zero-padded autocorrelation fits
+	int factor = 1;
+	while ((nextPowerOfTwo(2*((texture.cols + factor - 1)/factor)) > AUTOCORRELATION_MAX_SIZE) ||
+			(nextPowerOfTwo(2*((texture.rows + factor - 1)/factor)) > AUTOCORRELATION_MAX_SIZE)){
+		factor++;
+	}
+
+	PlaneRaster raster;
+	raster.width = (texture.cols + factor - 1)/factor;
+	raster.height = (texture.rows + factor - 1)/factor;
+	raster.pixelSize = facade.getPixelSize()*factor;
+	raster.frame = facade.getFrame();
+	// block centers
+	raster.origin = facade.getTextureOrigin() + Vector2d(1,1)*facade.getPixelSize()*(factor-1)/2.0;
+	raster.values = vector<double>(raster.width*raster.height, 0);
+	raster.weights = vector<double>(raster.width*raster.height, 0);
+
+	for (int y = 0; y < texture.rows; y++){
+		const float* textureRow = texture.ptr<float>(y);
+		const unsigned char* coverageRow = coverage.ptr<unsigned char>(y);
+		for (int x = 0; x < texture.cols; x++){
+			if (coverageRow[x] > 0){
+				int index = (y/factor)*raster.width + x/factor;
+				raster.values[index] += textureRow[x];
+				raster.weights[index] += 1;
+			}
+		}
+	}
+
+	double sum = 0;
+	double weightSum = 0;
+	for (size_t i = 0; i < raster.values.size(); i++){
+		if (raster.weights[i] > 0){
+			raster.values[i] /= raster.weights[i];
+			sum += raster.values[i];
+			weightSum += 1;
+		}
+	}
+
+	// zero mean over the covered pixels, uncovered pixels do not contribute
+	double mean = (weightSum > 0) ? sum/weightSum : 0;
+	for (size_t i = 0; i < raster.values.size(); i++){
+		if (raster.weights[i] > 0){
+			raster.values[i] -= mean;
+			raster.weights[i] = 1;
+		}
+	}
+
+	return raster;
+}
+
+LatticeDetector::PlaneRaster LatticeDetector::rasterizePoints(){
+
+	PlaneRaster raster;
+	raster.frame = frame;
+
+	vector<Vector2d> coordinates = vector<Vector2d>();
+	coordinates.reserve(points.size());
+	Vector2d minCorner = Vector2d(0,0);
+	Vector2d maxCorner = Vector2d(0,0);
+
+	for (size_t i = 0; i < points.size(); i++){
+		coordinates.push_back(raster.frame.toPlane(points[i]));
+		if (i == 0){
+			minCorner = coordinates[0];
+			maxCorner = coordinates[0];
+		}
+		minCorner = minCorner.cwiseMin(coordinates[i]);
+		maxCorner = maxCorner.cwiseMax(coordinates[i]);
+	}
+
+	// one pixel border for the bilinear splats
+	raster.pixelSize = OCCUPANCY_PIXEL_SIZE;
+	raster.origin = minCorner - Vector2d(1,1)*raster.pixelSize;
+	raster.width = (int)ceil((maxCorner(0) - minCorner(0)) / raster.pixelSize) + 3;
+	raster.height = (int)ceil((maxCorner(1) - minCorner(1)) / raster.pixelSize) + 3;
+
+	// bound the raster size, coarser pixels for very large groups
+	int maxSize = AUTOCORRELATION_MAX_SIZE/2;
+	if ((raster.width > maxSize) || (raster.height > maxSize)){
+		double scale = max(raster.width, raster.height) / (double)maxSize;
+		raster.pixelSize *= scale;
+		raster.origin = minCorner - Vector2d(1,1)*raster.pixelSize;
+		raster.width = min(maxSize, (int)ceil((maxCorner(0) - minCorner(0)) / raster.pixelSize) + 3);
+		raster.height = min(maxSize, (int)ceil((maxCorner(1) - minCorner(1)) / raster.pixelSize) + 3);
+	}
+
+	raster.values = vector<double>(raster.width*raster.height, 0);
+
+	for (size_t i = 0; i < coordinates.size(); i++){
+		Vector2d pixel = (coordinates[i] - raster.origin) / raster.pixelSize;
+		int x0 = (int)floor(pixel(0));
+		int y0 = (int)floor(pixel(1));
+		double fx = pixel(0) - x0;
+		double fy = pixel(1) - y0;
+
+		x0 = max(0, min(raster.width - 2, x0));
+		y0 = max(0, min(raster.height - 2, y0));
+
+		raster.values[y0*raster.width + x0] += (1-fx)*(1-fy);
+		raster.values[y0*raster.width + x0+1] += fx*(1-fy);
+		raster.values[(y0+1)*raster.width + x0] += (1-fx)*fy;
+		raster.values[(y0+1)*raster.width + x0+1] += fx*fy;
+	}
+
+	return raster;
+}
+
+vector<Vector2d> LatticeDetector::autocorrelationPeaks(PlaneRaster const &raster){
+
+	int paddedWidth, paddedHeight;
+	vector<double> correlation = autocorrelation2d(raster.values, raster.width, raster.height, paddedWidth, paddedHeight);
+
+	// normalize by the overlap of the covered areas, so large shifts are not penalized for covering less texture
+	if (!raster.weights.empty()){
+		vector<double> overlap = autocorrelation2d(raster.weights, raster.width, raster.height, paddedWidth, paddedHeight);
+		double fullOverlap = overlap[0];
+
+		for (size_t i = 0; i < correlation.size(); i++){
+			if (overlap[i] >= AUTOCORRELATION_MIN_OVERLAP*fullOverlap){
+				correlation[i] /= overlap[i];
+			}
+			else{
+				correlation[i] = 0;
+			}
+		}
+	}
+
+	// suppress everything closer than the shortest accepted basis vector, to one peak per translation
+	int radius = max(1, (int)floor(VECTOR_DISTANCE / raster.pixelSize));
+
+	struct Peak{
+		Vector2d shift;
+		double value;
+	};
+	vector<Peak> peaks = vector<Peak>();
+
+	// only one of two opposite shifts (the autocorrelation is symmetric), and no wrap-around
+	for (int dy = 0; dy < raster.height; dy++){
+		for (int dx = -raster.width + 1; dx < raster.width; dx++){
+
+			if ((dy == 0) && (dx <= 0)){
+				continue;
+			}
+			if (dx*dx + dy*dy <= radius*radius){
+				continue;
+			}
+
+			double value = correlation[dy*paddedWidth + (dx + paddedWidth) % paddedWidth];
+			if (value <= 0){
+				continue;
+			}
+
+			bool isMaximum = true;
+			for (int ny = dy - radius; ny <= dy + radius && isMaximum; ny++){
+				for (int nx = dx - radius; nx <= dx + radius; nx++){
+					if ((nx == dx) && (ny == dy)){
+						continue;
+					}
+					double neighbour = correlation[((ny + paddedHeight) % paddedHeight)*paddedWidth + (nx + paddedWidth) % paddedWidth];
+					// ties are resolved towards the first one in scan order
+					if ((neighbour > value) || ((neighbour == value) && ((ny < dy) || ((ny == dy) && (nx < dx))))){
+						isMaximum = false;
+						break;
+					}
+				}
+			}
+			if (!isMaximum){
+				continue;
+			}
+
+			// parabolic sub-pixel refinement in both directions
+			double left = correlation[dy*paddedWidth + (dx - 1 + paddedWidth) % paddedWidth];
+			double right = correlation[dy*paddedWidth + (dx + 1 + paddedWidth) % paddedWidth];
+			double down = correlation[((dy - 1 + paddedHeight) % paddedHeight)*paddedWidth + (dx + paddedWidth) % paddedWidth];
+			double up = correlation[((dy + 1) % paddedHeight)*paddedWidth + (dx + paddedWidth) % paddedWidth];
+
+			Peak peak;
+			peak.shift = Vector2d(dx, dy);
+			double curvatureX = left - 2*value + right;
+			double curvatureY = down - 2*value + up;
+			if (curvatureX < 0){
+				peak.shift(0) += 0.5*(left - right)/curvatureX;
+			}
+			if (curvatureY < 0){
+				peak.shift(1) += 0.5*(down - up)/curvatureY;
+			}
+			peak.value = value;
+
+			peaks.push_back(peak);
+		}
+	}
+
+	std::sort(peaks.begin(), peaks.end(), [](Peak const &a, Peak const &b) { return a.value > b.value; });
+
+	vector<Vector2d> shifts = vector<Vector2d>();
+
+	for (size_t i = 0; i < peaks.size() && (int)i < AUTOCORRELATION_MAX_CANDIDATES; i++){
+		if (peaks[i].value < AUTOCORRELATION_PEAK_RATIO*peaks[0].value){
+			break;
+		}
+		shifts.push_back(peaks[i].shift);
+	}
+
+	return shifts;
+}
+
 void LatticeDetector::combineCandidates(list<list<Vector3d> > const &clusteredCandidates, vector<Vector3d> &combinedCandidates, vector<int> &scores){
 
 	list<list<Vector3d> >::const_iterator clusterItOuter;
@@ -160,91 +464,217 @@ int LatticeDetector::vectorsAreSimilar(Vector3d const &vector1, Vector3d const &
 	}
 }
 
-// Clusters candidates together if they are similar. Clusters are lists of candidate vectors, themselves stored in a list
+// Clusters candidates together if they are similar. Clusters are lists of candidate vectors, themselves stored in a list.
+// Single-link clustering: two candidates end up in the same cluster if they are connected by a chain of similar candidates.
+// Instead of comparing every candidate with every cluster member, the candidates are bucketed into a uniform grid in the plane
+// with cell size VECTOR_DISTANCE, and only candidates in neighbouring cells are compared.
 list<list<Vector3d> > LatticeDetector::clusterCandidates(vector<Vector3d> const &candidates){
 
-	vector<Vector3d>::const_iterator candidateIt;
-	list<list<Vector3d> >::iterator clusterItOuter;
-	list<Vector3d>::iterator clusterItInner;
+	int n = candidates.size();
+	double cellSize = VECTOR_DISTANCE;
 
-	list<list<Vector3d> > clusteredCandidates = list<list<Vector3d> >(0);
+	// sign-canonicalized 2d plane coordinates. Opposite candidates are similar, after canonicalization they lie in the same half-plane.
+	vector<Vector2d> coordinates = vector<Vector2d>(n);
+	unordered_map<long long, vector<int> > grid = unordered_map<long long, vector<int> >();
+	grid.reserve(n);
 
-	for(candidateIt = candidates.begin(); candidateIt!=candidates.end(); ++candidateIt){
+	for (int i = 0; i < n; i++){
+		Vector2d coordinate = frame.directionToPlane(candidates[i]);
+		if ((coordinate(0) < 0) || ((coordinate(0) == 0) && (coordinate(1) < 0))){
+			coordinate = -coordinate;
+		}
+		coordinates[i] = coordinate;
 
-		// Make a new cluster for the candidate
-		list<Vector3d> cluster = list<Vector3d>();
-		cluster.push_back(*candidateIt);
+		grid[gridCellKey((int)floor(coordinate(0)/cellSize), (int)floor(coordinate(1)/cellSize))].push_back(i);
+	}
 
-		for (clusterItOuter = clusteredCandidates.begin(); clusterItOuter!=clusteredCandidates.end();){ // iterator is increased manually!
+	UnionFind clusters = UnionFind(n);
 
-			bool inCluster = false;
+	for (int i = 0; i < n; i++){
 
-			// Search all the vectors in the current cluster. If one of them is similar to the candidate vector,
-			// the current cluster shall be merged into the candidate's cluster.
-			// Note: More than one existing cluster can be merged into the newly formed cluster.
-			for(clusterItInner = (*clusterItOuter).begin(); clusterItInner != (*clusterItOuter).end(); ++clusterItInner){
-				if (vectorsAreSimilar(*candidateIt, *clusterItInner, VECTOR_DISTANCE) > 0){
-					inCluster = true;
-					break;
-				}
-			}
-			if (inCluster){
-				// Merge the old cluster into the new cluster
-				cluster.splice(cluster.end(), *clusterItOuter);
-				// Remove the old cluster from the list. Advances iterator automatically.
-				clusterItOuter=clusteredCandidates.erase(clusterItOuter);
+		// Similar candidates lie within VECTOR_DISTANCE of the candidate or of its negative (the 2d distance is never larger than the 3d one),
+		// so within the 3x3 cells around either of them. Only the negative of a candidate close to the half-plane border can have neighbours.
+		for (int sign = 1; sign >= -1; sign -= 2){
+			Vector2d coordinate = coordinates[i]*sign;
+			int cellX = (int)floor(coordinate(0)/cellSize);
+			int cellY = (int)floor(coordinate(1)/cellSize);
+
+			if ((sign == -1) && (cellX < -1)){
+				continue;
 			}
-			else{
-				// increase iterator
-				++clusterItOuter;
+
+			for (int dy = -1; dy <= 1; dy++){
+				for (int dx = -1; dx <= 1; dx++){
+					unordered_map<long long, vector<int> >::const_iterator cell = grid.find(gridCellKey(cellX + dx, cellY + dy));
+					if (cell == grid.end()){
+						continue;
+					}
+					for (size_t k = 0; k < cell->second.size(); k++){
+						int j = cell->second[k];
+						// compare each pair once, and skip pairs that are already connected
+						if ((j <= i) || (clusters.find(i) == clusters.find(j))){
+							continue;
+						}
+						if (vectorsAreSimilar(candidates[i], candidates[j], VECTOR_DISTANCE) > 0){
+							clusters.unite(i, j);
+						}
+					}
+				}
 			}
 		}
+	}
 
-		// append the new cluster to the list
-		clusteredCandidates.push_back(cluster);
+	// Collect the clusters. As before, a cluster comes after all clusters whose last member comes before its last member.
+	vector<int> lastMember = vector<int>(n, -1);
+	for (int i = 0; i < n; i++){
+		lastMember[clusters.find(i)] = i;
+	}
+
+	vector<int> clusterOrder = vector<int>(n, -1);
+	int clusterCount = 0;
+	for (int i = 0; i < n; i++){
+		if (lastMember[i] != -1){
+			clusterOrder[lastMember[i]] = i;
+			clusterCount++;
+		}
+	}
+
+	vector<list<Vector3d> > clusterMembers = vector<list<Vector3d> >(n);
+	for (int i = 0; i < n; i++){
+		clusterMembers[clusters.find(i)].push_back(candidates[i]);
+	}
+
+	list<list<Vector3d> > clusteredCandidates = list<list<Vector3d> >(0);
+	for (int i = 0; i < n; i++){
+		if (clusterOrder[i] != -1){
+			clusteredCandidates.push_back(list<Vector3d>());
+			clusteredCandidates.back().swap(clusterMembers[clusterOrder[i]]);
+		}
 	}
 
 	return clusteredCandidates;
 
 }
 
-vector<double> LatticeDetector::validateCandidateVectors(vector<Vector3d> const &candidateVectors){
+long long LatticeDetector::gridCellKey(int x, int y){
+	return ((long long)x << 32) ^ (long long)(unsigned int)y;
+}
 
-	vector<double> scores = vector<double>();
+vector<double> LatticeDetector::validateCandidateVectors(vector<Vector3d> const &candidateVectors, ValidityMode mode){
+
+	int candidateCount = candidateVectors.size();
+	int pointCount = points.size();
 
-	vector<Vector3d>::const_iterator candidateIt;
+	// the texture is computed up front, not by the first worker that needs it
+	if (mode == RECTIFIED_VALIDATION){
+		getRectifiedFacade();
+	}
+
+	// every (candidate vector, reference point) pair is independent, validate all of them in parallel.
+	// The pairs are handed out point-major, so if the budget runs out, all candidates were validated on about as many points.
+	vector<double> pointScores = vector<double>(candidateCount*pointCount, 0);
+	vector<char> validated = vector<char>(candidateCount*pointCount, 0);
+
+	parallelFor(candidateCount*pointCount, [&](int pair){
+		// pairs not validated before the budget ran out are left out of the scores
+		if (budgetExhausted()){
+			return;
+		}
+		int point = pair / candidateCount;
+		int candidate = pair % candidateCount;
+		pointScores[candidate*pointCount + point] = validInvalidRatio(points[point], candidateVectors[candidate], mode);
+		validated[candidate*pointCount + point] = 1;
+	}, threadCount);
+
+	// sum up serially in the order of the points, so the scores do not depend on the scheduling
+	vector<double> scores = vector<double>();
 
-	// store the score of every candidate vector
-	for(candidateIt = candidateVectors.begin(); candidateIt != candidateVectors.end(); ++candidateIt){
-		double score = validateVector(*candidateIt);
+	for (int candidate = 0; candidate < candidateCount; candidate++){
+		double score = 0;
+		int validatedCount = 0;
+		for (int point = 0; point < pointCount; point++){
+			score = score + pointScores[candidate*pointCount + point];
+			validatedCount += validated[candidate*pointCount + point];
+		}
+		// partially validated candidates are compared by their mean ratio, scaled to the number of points
+		if ((validatedCount > 0) && (validatedCount < pointCount)){
+			score = score * pointCount / validatedCount;
+		}
+		if (validatedCount < pointCount){
+			partialScores = true;
+		}
 		scores.push_back(score);
 	}
 
+	if ((mode == OCCUPANCY_VALIDATION) && (tieBreakValidityMode != OCCUPANCY_VALIDATION)){
+		breakTiesByAppearance(candidateVectors, scores);
+	}
+
 	return scores;
 
 }
 
-double LatticeDetector::validateVector(Vector3d const &candidateVector){
+void LatticeDetector::breakTiesByAppearance(vector<Vector3d> const &candidateVectors, vector<double> &scores){
+
+	if (scores.size() < 2){
+		return;
+	}
+
+	vector<int> order(scores.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return scores[a] > scores[b]; });
 
-	vector<Vector3d>::iterator pointsIt;
+	double bestScore = scores[order[0]];
+	if (bestScore <= 0){
+		return;
+	}
+
+	// shortlist the candidates tied with the best one
+	vector<Vector3d> shortlist = vector<Vector3d>();
+	vector<int> shortlistIndices = vector<int>();
+	for (size_t k = 0; (k < order.size()) && ((int)k < OCCUPANCY_SHORTLIST_SIZE); k++){
+		if (scores[order[k]] < (1 - OCCUPANCY_TIE_RATIO)*bestScore){
+			break;
+		}
+		shortlist.push_back(candidateVectors[order[k]]);
+		shortlistIndices.push_back(order[k]);
+	}
 
-	double imageValidationScore = 0;
+	if (shortlist.size() < 2){
+		return;
+	}
 
-	// sum up the score (ration between valid and invalid grid points) of every reference point
-	for(pointsIt = points.begin(); pointsIt != points.end(); ++pointsIt){
+	// score the shortlist by appearance (does not recurse, the tie break mode is not OCCUPANCY_VALIDATION)
+	vector<double> appearanceScores = validateCandidateVectors(shortlist, tieBreakValidityMode);
 
-		double pointScore = validInvalidRatio((*pointsIt), candidateVector);
-		imageValidationScore = imageValidationScore + pointScore;
+	for (size_t k = 0; k < shortlist.size(); k++){
+		scores[shortlistIndices[k]] = bestScore + appearanceScores[k] / (points.size() + 1);
 	}
+}
 
-	return imageValidationScore;
+double LatticeDetector::validateVector(Vector3d const &candidateVector){
+
+	// sum up the score (ration between valid and invalid grid points) of every reference point.
+	// Serial: a single vector is not worth starting the threads of parallelFor.
+	double score = 0;
+	for (size_t point = 0; point < points.size(); point++){
+		if (budgetExhausted()){
+			break;
+		}
+		score = score + validInvalidRatio(points[point], candidateVector, validityMode);
+	}
+	return score;
 }
 
-double LatticeDetector::validInvalidRatio(Vector3d const &referencePoint, Vector3d const &candidateVector){
+double LatticeDetector::validInvalidRatio(Vector3d const &referencePoint, Vector3d const &candidateVector, ValidityMode mode){
+
+	// the on-grid search runs in plane coordinates, only the validation needs 3d points
+	Vector2d referencePoint2d = frame.toPlane(referencePoint);
+	Vector2d candidateVector2d = frame.directionToPlane(candidateVector);
 
-	vector<Vector3d> projectedPoints = projectPointsOnLine(referencePoint, candidateVector);
+	vector<double> projectionFactors = projectPointsOnLine(referencePoint2d, candidateVector2d);
 
-	vector<int> outermostOnGridPointIndices = getOutermostOnGridPointIndices(projectedPoints, referencePoint, candidateVector);
+	vector<int> outermostOnGridPointIndices = getOutermostOnGridPointIndices(projectionFactors, referencePoint2d, candidateVector2d);
 
 	int minIndex = outermostOnGridPointIndices[0];
 	int maxIndex = outermostOnGridPointIndices[1];
@@ -255,10 +685,11 @@ double LatticeDetector::validInvalidRatio(Vector3d const &referencePoint, Vector
 	// initialize with -1 as the reference point will raise it to 0
 	int validCount = -1;
 
-	// check whether points between the outermost on grid points are valid
+	// check whether points between the outermost on grid points are valid, all in one batch
+	vector<bool> validity = arePointsValid(referencePoint, gridPointsOnLine(referencePoint, candidateVector, minIndex, 1, maxIndex - minIndex + 1), mode);
+
 	for (int index = minIndex; index <= maxIndex; index++){
-		Vector3d pointToTest = referencePoint + candidateVector*index;
-		if (isPointValid(referencePoint, pointToTest)){
+		if (validity[index - minIndex]){
 			validCount++;
 			if(index < smallestValidIndex){
 				smallestValidIndex = index;
@@ -273,10 +704,20 @@ double LatticeDetector::validInvalidRatio(Vector3d const &referencePoint, Vector
 	int totalCount = highestValidIndex - smallestValidIndex;
 
 	// expand into negative direction if treshold wasn't met yet
+	// Grid points are validated in batches, but consumed one by one, so the expansion stops at the same index.
 	int index = smallestValidIndex - 1;
+	size_t batchPosition = 0;
+	validity.clear();
 	while((totalCount == 0) || ((((double)validCount) / ((double)totalCount)) >= TRESHOLD2)){
-		Vector3d pointToTest = referencePoint + candidateVector*index;
-		if (isPointValid(referencePoint, pointToTest)){
+		// stop expanding if the budget ran out, the ratio so far is kept
+		if (budgetExhausted()){
+			break;
+		}
+		if (batchPosition == validity.size()){
+			validity = arePointsValid(referencePoint, gridPointsOnLine(referencePoint, candidateVector, index, -1, EXPANSION_BATCH_SIZE), mode);
+			batchPosition = 0;
+		}
+		if (validity[batchPosition++]){
 			validCount++;
 			smallestValidIndex = index;
 		}
@@ -289,9 +730,18 @@ double LatticeDetector::validInvalidRatio(Vector3d const &referencePoint, Vector
 
 	// expand into positive direction if treshold wasn't met yet
 	index = maxIndex + 1;
+	batchPosition = 0;
+	validity.clear();
 	while((totalCount == 0) || ((((double)validCount) / ((double)totalCount)) >= TRESHOLD2)){
-		Vector3d pointToTest = referencePoint + candidateVector*index;
-		if (isPointValid(referencePoint, pointToTest)){
+		// stop expanding if the budget ran out, the ratio so far is kept
+		if (budgetExhausted()){
+			break;
+		}
+		if (batchPosition == validity.size()){
+			validity = arePointsValid(referencePoint, gridPointsOnLine(referencePoint, candidateVector, index, 1, EXPANSION_BATCH_SIZE), mode);
+			batchPosition = 0;
+		}
+		if (validity[batchPosition++]){
 			validCount++;
 			highestValidIndex = index;
 		}
@@ -312,81 +762,51 @@ double LatticeDetector::validInvalidRatio(Vector3d const &referencePoint, Vector
 }
 
 // project points on the line through referencePoint in the direction of candidateVector
-vector<Vector3d> LatticeDetector::projectPointsOnLine(Vector3d const &referencePoint, Vector3d const &candidateVector){
-
-	vector<Vector3d> projectedPoints = vector<Vector3d>();
-	projectedPoints.reserve(points.size());
+vector<double> LatticeDetector::projectPointsOnLine(Vector2d const &referencePoint, Vector2d const &candidateVector){
 
-	vector<Vector3d>::iterator pointsIt;
+	vector<double> projectionFactors = vector<double>();
+	projectionFactors.reserve(points2d.size());
 
-	for(pointsIt = points.begin(); pointsIt != points.end(); ++pointsIt){
+	double candidateSquaredNorm = candidateVector.dot(candidateVector);
 
-		// point P, reference point R
-		Vector3d point = (*pointsIt);
+	for(size_t i = 0; i < points2d.size(); i++){
 
-		// calculate RP
-		Vector3d vectorRefToPoint = point-referencePoint;
-
-		// project RP onto candidateVector C: RP' = (RP*C/(C*C))*C
-		Vector3d projectionOnCandidateVector = (vectorRefToPoint.dot(candidateVector) / candidateVector.dot(candidateVector) ) * candidateVector;
-
-		// find P' by adding R and RP'
-		Vector3d projectedPoint = referencePoint+projectionOnCandidateVector;
-
-		projectedPoints.push_back(projectedPoint);
+		// project RP onto candidateVector C: RP' = (RP*C/(C*C))*C, keep the signed factor only
+		projectionFactors.push_back((points2d[i] - referencePoint).dot(candidateVector) / candidateSquaredNorm);
 	}
 
-	return projectedPoints;
+	return projectionFactors;
 }
 
 // returns the indices of the two outermost grid points that have reconstructed points on them
-vector<int> LatticeDetector::getOutermostOnGridPointIndices(vector<Vector3d> const &projectedPoints, Vector3d const &referencePoint, Vector3d const &candidateVector){
+vector<int> LatticeDetector::getOutermostOnGridPointIndices(vector<double> const &projectionFactors, Vector2d const &referencePoint, Vector2d const &candidateVector){
 
 	int minIndex = 0;
 	int maxIndex = 0;
 
-	vector<Vector3d>::const_iterator projectedPointsIt;
-
-	// This iterator is advanced in the same way as projectedPointsIt, but explicitly
-	vector<Vector3d>::iterator originalPointsIt;
-
-	originalPointsIt = points.begin();
-
 	// Iterate through the (projected) points
-	for (projectedPointsIt = projectedPoints.begin(); projectedPointsIt != projectedPoints.end(); ++projectedPointsIt){
-
-		Vector3d projectedPoint = *projectedPointsIt;
-		Vector3d originalPoint = *originalPointsIt;
+	for (size_t i = 0; i < projectionFactors.size(); i++){
 
-		// projectedPoint = referencePoint + candidateVector*factor
-		// factor = |(projectedPoint - referencePoint)| / |candidateVector|
-		double factor = (projectedPoint - referencePoint).norm() / candidateVector.norm();
-
-		// the sign of the factor is missing, so test for it separately
-		double diffWithPlus = ((referencePoint + candidateVector*factor) - projectedPoint).norm();
-		double diffWithMinus = ((referencePoint - candidateVector*factor) - projectedPoint).norm();
-		if (diffWithMinus < diffWithPlus){
-			factor = -factor;
-		}
+		// projectedPoint = referencePoint + candidateVector*factor, the factor is already signed
+		double factor = projectionFactors[i];
 
 		// Find the most adjacent two grid points
 		int previousGridPointIndex = floor(factor);
 		int nextGridPointIndex = ceil(factor);
 
-		Vector3d previousGridPoint = referencePoint + candidateVector*previousGridPointIndex;
-		Vector3d nextGridPoint = referencePoint + candidateVector*nextGridPointIndex;
+		Vector2d previousGridPoint = referencePoint + candidateVector*previousGridPointIndex;
+		Vector2d nextGridPoint = referencePoint + candidateVector*nextGridPointIndex;
 
 		int finalGridPointIndex;
 
 		// Check whether the original point is on-grid
-		if(pointEqualsGridPoint(originalPoint, previousGridPoint, candidateVector)){ // Point is on-grid on the previous grid point
+		if(pointEqualsGridPoint(points2d[i], previousGridPoint, candidateVector)){ // Point is on-grid on the previous grid point
 			finalGridPointIndex = previousGridPointIndex;
 		}
-		else if(pointEqualsGridPoint(originalPoint, nextGridPoint, candidateVector)){ // Point is on-grid on the next grid point
+		else if(pointEqualsGridPoint(points2d[i], nextGridPoint, candidateVector)){ // Point is on-grid on the next grid point
 			finalGridPointIndex = nextGridPointIndex;
 		}
 		else{
-			++originalPointsIt;
 			continue;
 		}
 
@@ -397,8 +817,6 @@ vector<int> LatticeDetector::getOutermostOnGridPointIndices(vector<Vector3d> con
 		else if(finalGridPointIndex > maxIndex){
 			maxIndex = finalGridPointIndex;
 		}
-
-		++originalPointsIt;
 	}
 
 	vector<int> outermostOnGridPointIndices = vector<int>();
@@ -409,66 +827,79 @@ vector<int> LatticeDetector::getOutermostOnGridPointIndices(vector<Vector3d> con
 	return outermostOnGridPointIndices;
 }
 
-bool LatticeDetector::pointEqualsGridPoint(Vector3d const &point, Vector3d const &gridPoint, Vector3d const &vector){
+bool LatticeDetector::pointEqualsGridPoint(Vector2d const &point, Vector2d const &gridPoint, Vector2d const &vector){
 
-	double treshold = vector.norm() * TRESHOLD1;
+	// |point - gridPoint| < |vector|*TRESHOLD1, compared squared
+	double squaredTreshold = vector.squaredNorm() * TRESHOLD1 * TRESHOLD1;
 
-	bool equals = (point - gridPoint).norm() < treshold;
+	bool equals = (point - gridPoint).squaredNorm() < squaredTreshold;
 
 	return equals;
 }
 
 void LatticeDetector::calculateLatticeBoundary(Vector3d const &latticeVector1, Vector3d const &latticeVector2, Vector3d &cornerOut, int &widthOut, int &heightOut){
 
-	vector<Vector3d>::iterator referencePointsIt;
-
-	int finalArea = -1;
-	int finalWidth = 0;
-	int finalHeight = 0;
-	Vector3d finalCorner = Vector3d(0,0,0);
-
-	for(referencePointsIt = points.begin(); referencePointsIt != points.end(); ++referencePointsIt){
-		Vector3d referencePoint = (*referencePointsIt);
+	// assume latticeVector1 to point towards "right", latticeVector2 to point towards "up"
 
-		int width;
-		int height;
-		Vector3d corner;
-		latticeBoundaryForReferencePoint(referencePoint, latticeVector1, latticeVector2, corner, width, height);
+	widthOut = 0;
+	heightOut = 0;
+	cornerOut = Vector3d(0,0,0);
 
-		int area = (width + 1) * (height + 1);
+	if (points.empty()){
+		return;
+	}
 
-		if (area > finalArea){
-			finalArea = area;
-			finalWidth = width;
-			finalHeight = height;
-			finalCorner = corner;
+	// The appearance reference and grid origin is the point closest to the centroid (the frame origin). All grid points are
+	// compared with it, so the validity of a grid point is computed once and shared by all expansion steps.
+	int anchorIndex = 0;
+	for (size_t i = 1; i < points2d.size(); i++){
+		if (points2d[i].squaredNorm() < points2d[anchorIndex].squaredNorm()){
+			anchorIndex = i;
 		}
 	}
 
-	widthOut = finalWidth;
-	heightOut = finalHeight;
-	cornerOut = finalCorner;
-
-}
-
-void LatticeDetector::latticeBoundaryForReferencePoint(Vector3d const &referencePoint, Vector3d const &latticeVector1, Vector3d const &latticeVector2, Vector3d &cornerOut, int &widthOut, int &heightOut){
+	CellValidityMemo memo;
+	memo.anchor = points[anchorIndex];
+	memo.vector1 = latticeVector1;
+	memo.vector2 = latticeVector2;
 
-	// assume latticeVector1 to point towards "right", latticeVector2 to point towards "up"
-
-	Vector3d lowerLeft = referencePoint;
-	Vector3d upperRight = referencePoint;
+	// the on-grid points seed the explored window, so the expansion does not have to reach them through invalid lines
+	vector<Vector2d> relativePoints = vector<Vector2d>();
+	relativePoints.reserve(points2d.size());
+	for (size_t i = 0; i < points2d.size(); i++){
+		relativePoints.push_back(points2d[i] - points2d[anchorIndex]);
+	}
+	vector<Vector2d> pointsInLatticeBasis = changeToLatticeBasis(relativePoints, frame.directionToPlane(latticeVector1), frame.directionToPlane(latticeVector2));
+
+	int minI = 0, maxI = 0, minJ = 0, maxJ = 0;
+	for (size_t k = 0; k < pointsInLatticeBasis.size(); k++){
+		int i = (int)floor(pointsInLatticeBasis[k][0] + 0.5);
+		int j = (int)floor(pointsInLatticeBasis[k][1] + 0.5);
+		if ((abs(pointsInLatticeBasis[k][0] - i) < TRESHOLD1) && (abs(pointsInLatticeBasis[k][1] - j) < TRESHOLD1)){
+			minI = min(minI, i);
+			maxI = max(maxI, i);
+			minJ = min(minJ, j);
+			maxJ = max(maxJ, j);
+		}
+	}
 
-	widthOut = 0;
-	heightOut = 0;
+	// validate the seed window in one batch
+	vector<pair<int,int> > windowCells = vector<pair<int,int> >();
+	for (int i = minI; i <= maxI; i++){
+		for (int j = minJ; j <= maxJ; j++){
+			windowCells.push_back(make_pair(i,j));
+		}
+	}
+	validateCells(memo, windowCells);
 
+	// expand the window while the new border lines are valid. If the budget runs out, the window explored so far is searched.
 	int unexpandableCount = 0;
 
-	while(unexpandableCount<4){
+	while((unexpandableCount<4) && !budgetExhausted()){
 
 		// expand right
-		if(validLine(referencePoint, upperRight + latticeVector1, -latticeVector2, heightOut)){
-			widthOut++;
-			upperRight = upperRight + latticeVector1;
+		if(lineValidRatio(memo, maxI+1, minJ, 0, 1, maxJ-minJ+1) >= TRESHOLD2){
+			maxI++;
 			unexpandableCount = 0;
 		}
 		else{
@@ -476,9 +907,8 @@ void LatticeDetector::latticeBoundaryForReferencePoint(Vector3d const &reference
 		}
 
 		// expand top
-		if(validLine(referencePoint, upperRight + latticeVector2, -latticeVector1, widthOut)){
-			heightOut++;
-			upperRight = upperRight + latticeVector2;
+		if(lineValidRatio(memo, minI, maxJ+1, 1, 0, maxI-minI+1) >= TRESHOLD2){
+			maxJ++;
 			unexpandableCount = 0;
 		}
 		else{
@@ -486,19 +916,17 @@ void LatticeDetector::latticeBoundaryForReferencePoint(Vector3d const &reference
 		}
 
 		// expand left
-		if(validLine(referencePoint, lowerLeft - latticeVector1, latticeVector2, heightOut)){
-			widthOut++;
-			lowerLeft = lowerLeft - latticeVector1;
+		if(lineValidRatio(memo, minI-1, minJ, 0, 1, maxJ-minJ+1) >= TRESHOLD2){
+			minI--;
 			unexpandableCount = 0;
 		}
-			else{
+		else{
 			unexpandableCount++;
 		}
 
 		// expand bottom
-		if(validLine(referencePoint, lowerLeft - latticeVector2, latticeVector1, widthOut)){
-			heightOut++;
-			lowerLeft = lowerLeft - latticeVector2;
+		if(lineValidRatio(memo, minI, minJ-1, 1, 0, maxI-minI+1) >= TRESHOLD2){
+			minJ--;
 			unexpandableCount = 0;
 		}
 		else{
@@ -506,124 +934,202 @@ void LatticeDetector::latticeBoundaryForReferencePoint(Vector3d const &reference
 		}
 	}
 
-	cornerOut = lowerLeft;
+	// integral image of the validity in the window. integral[(i+1)*(windowHeight+1) + j+1] = number of valid cells in [0,i]x[0,j]
+	int windowWidth = maxI - minI + 1;
+	int windowHeight = maxJ - minJ + 1;
+	vector<int> integral = vector<int>((windowWidth+1)*(windowHeight+1), 0);
+
+	for (int i = 0; i < windowWidth; i++){
+		int columnSum = 0;
+		for (int j = 0; j < windowHeight; j++){
+			columnSum += memo.validity[make_pair(minI+i, minJ+j)] ? 1 : 0;
+			integral[(i+1)*(windowHeight+1) + j+1] = integral[i*(windowHeight+1) + j+1] + columnSum;
+		}
+	}
+
+	auto validCount = [&](int i0, int j0, int i1, int j1){
+		return integral[(i1+1)*(windowHeight+1) + j1+1] - integral[i0*(windowHeight+1) + j1+1]
+				- integral[(i1+1)*(windowHeight+1) + j0] + integral[i0*(windowHeight+1) + j0];
+	};
 
+	// Maximal rectangle whose valid ratio, and the valid ratio of each of its border lines, is at least TRESHOLD2.
+	// Larger areas first, then more valid cells.
+	int finalArea = -1;
+	int finalValid = -1;
+
+	// Large rectangles are visited first, so smaller ones can be skipped early.
+	for (int i0 = 0; i0 < windowWidth; i0++){
+		for (int i1 = windowWidth-1; i1 >= i0; i1--){
+			int width = i1 - i0 + 1;
+			if (width*windowHeight < finalArea){
+				break;
+			}
+			for (int j0 = 0; j0 < windowHeight; j0++){
+				for (int j1 = windowHeight-1; j1 >= j0; j1--){
+					int height = j1 - j0 + 1;
+					int area = width*height;
+
+					// the area only shrinks with j1
+					if (area < finalArea){
+						break;
+					}
+
+					int valid = validCount(i0, j0, i1, j1);
+					if ((area == finalArea) && (valid <= finalValid)){
+						continue;
+					}
+					if (((double)valid)/area < TRESHOLD2){
+						continue;
+					}
+					if ((((double)validCount(i0, j0, i0, j1))/height < TRESHOLD2) || (((double)validCount(i1, j0, i1, j1))/height < TRESHOLD2) ||
+							(((double)validCount(i0, j0, i1, j0))/width < TRESHOLD2) || (((double)validCount(i0, j1, i1, j1))/width < TRESHOLD2)){
+						continue;
+					}
+
+					finalArea = area;
+					finalValid = valid;
+					widthOut = i1 - i0;
+					heightOut = j1 - j0;
+					cornerOut = memo.anchor + latticeVector1*(minI+i0) + latticeVector2*(minJ+j0);
+				}
+			}
+		}
+	}
+
+	if (finalArea == -1){
+		cornerOut = memo.anchor;
+	}
 }
 
-bool LatticeDetector::validLine(Vector3d const &referencePoint, Vector3d const &anchorPoint, Vector3d const &directionVector, int length){
+void LatticeDetector::validateCells(CellValidityMemo &memo, vector<pair<int,int> > const &cells){
 
-	int validCount = 0;
-	int totalCount = length+1;
+	// collect the cells that were not validated yet, and validate them all in one batch
+	vector<pair<int,int> > newCells = vector<pair<int,int> >();
+	vector<Vector3d> gridPoints = vector<Vector3d>();
 
-	for (int i = 0; i <= length; i++){
-		Vector3d pointToTest = anchorPoint + directionVector*i;
-		if(isPointValid(referencePoint, pointToTest)){
-			validCount++;
+	for (size_t k = 0; k < cells.size(); k++){
+		if (memo.validity.find(cells[k]) == memo.validity.end()){
+			newCells.push_back(cells[k]);
+			gridPoints.push_back(memo.anchor + memo.vector1*cells[k].first + memo.vector2*cells[k].second);
 		}
 	}
 
-	bool valid = ((double)validCount)/(double(totalCount)) >= TRESHOLD2;
+	vector<bool> validity = arePointsValid(memo.anchor, gridPoints, validityMode);
 
-	return valid;
+	for (size_t k = 0; k < newCells.size(); k++){
+		memo.validity[newCells[k]] = validity[k];
+	}
 }
 
+double LatticeDetector::lineValidRatio(CellValidityMemo &memo, int i, int j, int stepI, int stepJ, int count){
 
-vector<pair<int, vector<int> > > LatticeDetector:: getOnGridIndices(vector<int> const &inputIndices, LatticeStructure const &lattice){
+	vector<pair<int,int> > cells = vector<pair<int,int> >();
+	for (int k = 0; k < count; k++){
+		cells.push_back(make_pair(i + k*stepI, j + k*stepJ));
+	}
 
-	// assume latticeVector1 to point in positive "width" direction, latticeVector2 to point in positive "height" direction
+	validateCells(memo, cells);
 
-	vector<pair<int, vector<int> > > pointsToIndices = vector<pair<int, vector<int> > >();
+	int validCount = 0;
+	for (int k = 0; k < count; k++){
+		if (memo.validity[cells[k]]){
+			validCount++;
+		}
+	}
 
-	vector<Vector3d> gridPoints = vector<Vector3d>();
-	vector<vector<int> > gridPointIndices = vector<vector<int> >();
+	return ((double)validCount)/((double)count);
+}
+
+
+vector<LatticeGridIndex> LatticeDetector:: getOnGridIndices(vector<int> const &inputIndices, LatticeStructure const &lattice){
+
+	// assume latticeVector1 to point in positive "width" direction, latticeVector2 to point in positive "height" direction
 
-	// get lattice parameters
+	vector<LatticeGridIndex> pointsToIndices = vector<LatticeGridIndex>();
+
+	// get lattice parameters, in plane coordinates
 	int width = lattice.width;
 	int height = lattice.height;
-	Vector3d latticeVector1 = lattice.basisVectors[0];
-	Vector3d latticeVector2 = lattice.basisVectors[1];
-	Vector3d corner = lattice.corner;
+	Vector2d latticeVector1 = frame.directionToPlane(lattice.basisVectors[0]);
+	Vector2d latticeVector2 = frame.directionToPlane(lattice.basisVectors[1]);
+	Vector2d corner = frame.toPlane(lattice.corner);
+
+	// get all reconstructed points in basis of lattice, relative to the corner. Grid point (i,j) then has the coordinates (i,j).
+	vector<Vector2d> relativePoints = vector<Vector2d>();
+	relativePoints.reserve(points2d.size());
+	for (size_t j = 0; j < points2d.size(); j++){
+		relativePoints.push_back(points2d[j] - corner);
+	}
+	vector<Vector2d> reconstructedPointsInLatticeBasis = changeToLatticeBasis(relativePoints, latticeVector1, latticeVector2);
+
+	// closest on-grid point per grid point (index i*(height+1)+j), -1 if none
+	int numberOfGridPoints = (width+1)*(height+1);
+	vector<int> closestPoint = vector<int>(numberOfGridPoints, -1);
+	vector<double> minSquaredDistance = vector<double>(numberOfGridPoints, 0);
+
+	int numberOfReconstructedPoints = points2d.size();
+
+	// Every point can only be close to its nearest grid point, so every point is binned to that one grid point
+	for (int j = 0; j < numberOfReconstructedPoints; j++){
+
+		Vector2d reconstructedPointInLatticeBasis = reconstructedPointsInLatticeBasis[j];
+
+		int gridI = (int)floor(reconstructedPointInLatticeBasis[0] + 0.5);
+		int gridJ = (int)floor(reconstructedPointInLatticeBasis[1] + 0.5);
+
+		if ((gridI < 0) || (gridI > width) || (gridJ < 0) || (gridJ > height)){
+			continue;
+		}
+
+		// Determine whether the point is close to the grid point
+		// NOTE: "Close" has to be determined here wrt two different basis vectors, so the trivial check is not applicable.
+		// To combine both tresholds, we consider points as "close" if they lie in a parallelogram around the grid point,
+		// in a manner similar as depicted (on the left, depiction of the two basis vectors, parallelogram has the same shape,
+		// but only expands to TRESHOLD1*correspondingLatticeVector into each direction around the grid point, so the "valid"
+		// parallelogram area is bound by two vectors that correspond to TRESHOLD1*2*latticeVector1 and TRESHOLD1*2*latticeVector2
+		//
+		//         /     ______
+		//        /     /     /
+		//       /     /  .  /
+		//      /     /_____/
+		//	   /
+		//    /
+		//   /___________
+		//
+		// Thanks to a change to lattice basis coordinate system, the check whether a point is in that area can be done easily by
+		// checking each of the two coordinates of the distance vector separately.
+
+		bool onGridInWidth = abs(reconstructedPointInLatticeBasis[0] - gridI) < TRESHOLD1;
+		bool onGridInHeight = abs(reconstructedPointInLatticeBasis[1] - gridJ) < TRESHOLD1;
+		if (!(onGridInWidth && onGridInHeight)){
+			continue;
+		}
+
+		// Determine (squared) distance to the grid point
+		Vector2d gridPoint = corner + latticeVector1*gridI + latticeVector2*gridJ;
+		double squaredDistance = (gridPoint-points2d[j]).squaredNorm();
+
+		// if it is either the first found point or it is closer than all other found points, update
+		int cell = gridI*(height+1) + gridJ;
+		if((closestPoint[cell] == -1) || (squaredDistance < minSquaredDistance[cell])){
+			closestPoint[cell] = j;
+			minSquaredDistance[cell] = squaredDistance;
+		}
+	}
 
-	// get all grid points together with their indices
+	// If there was a reconstructed point found for a particular grid point, save it together with the grid indices
 	for (int i = 0; i <= width; i++){
 		for (int j = 0; j <= height; j++){
-			Vector3d gridPoint = corner + latticeVector1*i + latticeVector2*j;
-
-			vector<int> indices = vector<int>();
-			indices.push_back(i);
-			indices.push_back(j);
-
-			gridPoints.push_back(gridPoint);
-			gridPointIndices.push_back(indices);
-		}
-	}
-
-	// get all reconstructed points in basis of lattice
-	vector<Vector3d> reconstructedPointsInLatticeBasis = changeToLatticeBasis(points, latticeVector1, latticeVector2);
-	vector<Vector3d> gridPointsInLatticeBasis = changeToLatticeBasis(gridPoints, latticeVector1, latticeVector2);
-
-	int numberOfReconstructedPoints = points.size();
-	int numberOfGridPoints = gridPoints.size();
-
-	// For every grid point, find the reconstructed points lying on it and select the closest one
-	for (int i = 0; i < numberOfGridPoints; i++){
-
-		Vector3d gridPoint = gridPoints[i];
-		Vector3d gridPointInLatticeBasis = gridPointsInLatticeBasis[i];
-
-		double minDistance ;
-		vector<int> minIndices;
-
-		bool pointFound = false;
-
-		int jmin = -1;
-		for(int j = 0; j < numberOfReconstructedPoints; j++){
-
-			Vector3d reconstructedPointInLatticeBasis = reconstructedPointsInLatticeBasis[j];
-			Vector3d reconstructedPoint = points[j];
-
-			// Determine distance to the grid point
-			double distance = (gridPoint-reconstructedPoint).norm();
-
-			// Determine whether the point is close to a grid point
-			// NOTE: "Close" has to be determined here wrt two different basis vectors, so the trivial check is not applicable.
-			// To combine both tresholds, we consider points as "close" if they lie in a parallelogram around the grid point,
-			// in a manner similar as depicted (on the left, depiction of the two basis vectors, parallelogram has the same shape,
-			// but only expands to TRESHOLD1*correspondingLatticeVector into each direction around the grid point, so the "valid"
-			// parallelogram area is bound by two vectors that correspond to TRESHOLD1*2*latticeVector1 and TRESHOLD1*2*latticeVector2
-			//
-			//         /     ______
-			//        /     /     /
-			//       /     /  .  /
-			//      /     /_____/
-			//	   /
-			//    /
-			//   /___________
-			//
-			// Thanks to a change to lattice basis coordinate system, the check whether a point is in that area can be done easily by
-			// checking each of the first two coordinates of the distance vector separately.
-
-			Vector3d distanceVector = reconstructedPointInLatticeBasis-gridPointInLatticeBasis;
-			bool onGridInWidth = abs(distanceVector[0]) < TRESHOLD1;
-			bool onGridInHeight = abs(distanceVector[1]) < TRESHOLD1;
-			bool onGrid = onGridInWidth && onGridInHeight;
-
-			// if the point is on the grid and it is either the first found point or it is closer than all other found points, update
-			if(onGrid && (!pointFound || (distance < minDistance))){
-			//	if((distance < minDistance)){
-				pointFound = true;
-				minDistance = distance;
-				minIndices = gridPointIndices[i];
-				jmin = j;
+			int cell = i*(height+1) + j;
+			if (closestPoint[cell] == -1){
+				continue;
 			}
-		}
 
-		// If there was a reconstructed point found for that particular grid point, save it together with the grid indices
-		if(pointFound){
-			pair<int,vector<int> > indexPair = pair<int,vector<int> >();
-			indexPair.first = inputIndices[jmin];
-			indexPair.second = minIndices;
-			pointsToIndices.push_back(indexPair);
+			LatticeGridIndex gridIndex;
+			gridIndex.pointId = inputIndices[closestPoint[cell]];
+			gridIndex.i = i;
+			gridIndex.j = j;
+			pointsToIndices.push_back(gridIndex);
 		}
 	}
 
@@ -631,24 +1137,23 @@ vector<pair<int, vector<int> > > LatticeDetector:: getOnGridIndices(vector<int>
 }
 
 
-vector<Vector3d> LatticeDetector::changeToLatticeBasis(vector<Vector3d> const &inputPoints, Vector3d const &latticeVector1, Vector3d const &latticeVector2){
+vector<Vector2d> LatticeDetector::changeToLatticeBasis(vector<Vector2d> const &inputPoints, Vector2d const &latticeVector1, Vector2d const &latticeVector2){
 
-	vector<Vector3d> coordinatesInLatticeBasis = vector<Vector3d>();
+	vector<Vector2d> coordinatesInLatticeBasis = vector<Vector2d>();
+	coordinatesInLatticeBasis.reserve(inputPoints.size());
 
-	// Compose the transformationMatrix from lattice basis to canonical basis
-	Matrix3d transformationToCanonical = Matrix3d();
+	// Compose the transformationMatrix from lattice basis to plane coordinates
+	Matrix2d transformationToCanonical = Matrix2d();
 	transformationToCanonical.col(0) = latticeVector1;
 	transformationToCanonical.col(1) = latticeVector2;
-	transformationToCanonical.col(2) = latticeVector1.cross(latticeVector2);
 
-	// Inverse is the transformationMatrix from canonical basis to lattice basis
-	Matrix3d transformationToLatticeBasis = transformationToCanonical.inverse();
+	// Inverse is the transformationMatrix from plane coordinates to lattice basis (closed form for 2x2)
+	Matrix2d transformationToLatticeBasis = transformationToCanonical.inverse();
 
-	vector<Vector3d>::const_iterator pointsIt;
+	vector<Vector2d>::const_iterator pointsIt;
 
 	for(pointsIt = inputPoints.begin(); pointsIt < inputPoints.end(); ++pointsIt){
-		Vector3d transformedCoordinates = transformationToLatticeBasis * (*pointsIt);
-		coordinatesInLatticeBasis.push_back(transformedCoordinates);
+		coordinatesInLatticeBasis.push_back(transformationToLatticeBasis * (*pointsIt));
 	}
 
 	return coordinatesInLatticeBasis;
@@ -658,45 +1163,206 @@ vector<Vector3d> LatticeDetector::changeToLatticeBasis(vector<Vector3d> const &i
 //=================================================================================
 // Nektarios's
 
-bool LatticeDetector::isPointValid(Vector3d const &referencePoint, Vector3d const &pointToTest){
+vector<bool> LatticeDetector::arePointsValid(Vector3d const &referencePoint, vector<Vector3d> const &pointsToTest, ValidityMode mode){
+
+	vector<bool> valid(pointsToTest.size(), false);
 
-	bool valid = compareSiftFronto(referencePoint, pointToTest, this->plane,
-			this->inpManager->getK(), this->inpManager->getCamPoses(), this->inpManager->getViewIds(),
-			this->inpManager->getImgNames());
+	if (pointsToTest.empty()){
+		return valid;
+	}
+
+	if (budget != NULL){
+		budget->addSteps(pointsToTest.size());
+	}
+
+	// occupancy mode: geometry only, no image access
+	if (mode == OCCUPANCY_VALIDATION){
+		for (size_t i = 0; i < pointsToTest.size(); i++){
+			valid[i] = isOccupied(frame.toPlane(pointsToTest[i]));
+		}
+		return valid;
+	}
+
+	// rectified mode: patch comparisons by direct indexing into the texture
+	if (mode == RECTIFIED_VALIDATION && getRectifiedFacade().hasTexture()){
+		return getRectifiedFacade().arePointsSimilar(referencePoint, pointsToTest);
+	}
+
+	shared_ptr<CameraRig const> rig = this->inpManager->getCameraRig();
+
+	VectorXd const &s1 = referenceDescriptor(referencePoint, *rig);
+	if (s1.size() == 0){
+		return valid;
+	}
+
+	// group the points to test by their most frontoparallel view
+	map<int, vector<int> > pointIndicesPerView;
+	map<int, vector<Vector2d> > pixelsPerView;
+
+	vector<int> bestviews;
+	vector<Vector2d> pbests;
+	selectFrontoViews(toPointArray(pointsToTest), this->plane, *rig, bestviews, pbests);
+
+	for (size_t i = 0; i < pointsToTest.size(); i++){
+		if (bestviews[i] == -1){
+			continue;
+		}
+		pointIndicesPerView[bestviews[i]].push_back(i);
+		pixelsPerView[bestviews[i]].push_back(pbests[i]);
+	}
+
+	// compute all descriptors of one view with a single SIFT run, then compare them with the reference
+	map<int, vector<int> >::const_iterator viewIt;
+
+	for (viewIt = pointIndicesPerView.begin(); viewIt != pointIndicesPerView.end(); ++viewIt){
+
+		vector<VectorXd> descriptors;
+		if (computeSIFTBatch(getImage(viewIt->first), pixelsPerView[viewIt->first], descriptors) != 0){
+			continue;
+		}
+
+		vector<int> const &pointIndices = viewIt->second;
+		for (size_t k = 0; k < pointIndices.size(); k++){
+			valid[pointIndices[k]] = siftDescriptorsAreSimilar(s1, descriptors[k]);
+		}
+	}
 
 	return valid;
 }
 
-bool LatticeDetector::isIntegerCombination(int i,vector<Vector3d>& candidatesInOrder,vector<bool>& valid){
+bool LatticeDetector::isOccupied(Vector2d const &point){
+
+	double cellSize = OCCUPANCY_TOLERANCE;
 
-	Matrix<double,3,3> A;
-	Vector3d solution;
-	A.block<3,1>(0,2) = -candidatesInOrder.at(i);
+	// the grid is built in the constructor and never changed, reading it needs no lock
+	int cellX = (int)floor(point(0)/cellSize);
+	int cellY = (int)floor(point(1)/cellSize);
+	double squaredTolerance = OCCUPANCY_TOLERANCE*OCCUPANCY_TOLERANCE;
+
+	for (int dy = -1; dy <= 1; dy++){
+		for (int dx = -1; dx <= 1; dx++){
+			unordered_map<long long, vector<int> >::const_iterator cell = occupancyGrid.find(gridCellKey(cellX + dx, cellY + dy));
+			if (cell == occupancyGrid.end()){
+				continue;
+			}
+			for (size_t k = 0; k < cell->second.size(); k++){
+				if ((points2d[cell->second[k]] - point).squaredNorm() < squaredTolerance){
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
 
-	for (size_t j=i+1; j<candidatesInOrder.size(); j++){
-		if (!valid.at(j))
+VectorXd const &LatticeDetector::referenceDescriptor(Vector3d const &referencePoint, CameraRig const &rig){
+
+	vector<double> key(referencePoint.data(), referencePoint.data() + 3);
+
+	{
+		lock_guard<mutex> lock(cacheMutex);
+		map<vector<double>, VectorXd>::iterator cached = referenceDescriptorCache.find(key);
+		if (cached != referenceDescriptorCache.end()){
+			return cached->second;
+		}
+	}
+
+	// compute without holding the lock. If another thread was faster, its (identical) descriptor is kept.
+	VectorXd descriptor;
+
+	Vector2d pbest;
+	int bestview = selectFrontoView(referencePoint, this->plane, rig, pbest);
+
+	if (bestview != -1){
+		vector<VectorXd> descriptors;
+		if (computeSIFTBatch(getImage(bestview), vector<Vector2d>(1, pbest), descriptors) == 0){
+			descriptor = descriptors[0];
+		}
+	}
+
+	// map entries are never moved or erased, so the returned reference stays valid
+	lock_guard<mutex> lock(cacheMutex);
+	return referenceDescriptorCache.insert(make_pair(key, descriptor)).first->second;
+}
+
+cv::Mat const &LatticeDetector::getImage(int view){
+
+	{
+		lock_guard<mutex> lock(cacheMutex);
+		map<int, cv::Mat>::const_iterator cached = imageCache.find(view);
+		if (cached != imageCache.end()){
+			return cached->second;
+		}
+	}
+
+	// decoded without holding the lock, so different views are decoded concurrently.
+	// If another thread decoded the same view meanwhile, its (identical) image is kept.
+	cv::Mat image = loadGrayscaleImage(this->inpManager->getImgNames()[view]);
+
+	// map entries are never moved or erased, so the returned reference stays valid
+	lock_guard<mutex> lock(cacheMutex);
+	return imageCache.insert(make_pair(view, image)).first->second;
+}
+
+vector<Vector3d> LatticeDetector::gridPointsOnLine(Vector3d const &anchorPoint, Vector3d const &directionVector, int firstIndex, int step, int count){
+
+	vector<Vector3d> gridPoints = vector<Vector3d>();
+	gridPoints.reserve(count);
+
+	for (int k = 0; k < count; k++){
+		gridPoints.push_back(anchorPoint + directionVector*(firstIndex + k*step));
+	}
+
+	return gridPoints;
+}
+
+// whether the absolute value of a coefficient is within the tolerance of the paper of an integer
+static bool isNearInteger(double coefficient){
+	double fraction = fmod(fabs(coefficient), 1);
+	return (fraction < 0.012) || (fraction > 0.988);
+}
+
+bool LatticeDetector::isIntegerCombination(int i, vector<Vector2d> const &candidatesInOrder, vector<bool> const &valid){
+
+	Vector2d const &target = candidatesInOrder[i];
+	int n = candidatesInOrder.size();
+
+	// no pair left to combine
+	int validAfter = 0;
+	for (int j = i+1; j < n && validAfter < 2; j++){
+		validAfter += valid[j];
+	}
+	if (validAfter < 2)
+		return false;
+
+	for (int j=i+1; j<n; j++){
+		if (!valid[j])
 			continue;
 
-//		Vector3d n =  candidatesInOrder[i].cross(candidatesInOrder[j]);
-		A.block<3,1>(0,0) = candidatesInOrder.at(j);
+		Vector2d const &b1 = candidatesInOrder[j];
+
+		for (int k=j+1; k<n; k++){
+			if (!valid[k])
+				continue;
 
-		for (size_t k=j+1; k<candidatesInOrder.size(); k++){
-			if (!valid.at(k))
+			// solve a*b1 + b*b2 = target with Cramer's rule. Parallel pairs span no 2d lattice, skip them.
+			Vector2d const &b2 = candidatesInOrder[k];
+			double determinant = b1(0)*b2(1) - b1(1)*b2(0);
+			if (fabs(determinant) <= 1e-12*b1.norm()*b2.norm() || determinant == 0)
 				continue;
 
-			A.block<3,1>(0,1) = candidatesInOrder.at(k);
-			Eigen::JacobiSVD<Eigen::MatrixXd> svd(A, Eigen::ComputeThinU | Eigen::ComputeFullV);
+			// the second coefficient is only needed if the first one is an integer (or zero)
+			double a = fabs((target(0)*b2(1) - target(1)*b2(0)) / determinant);
+			if (!isNearInteger(a))
+				continue;
 
-			solution = svd.matrixV().block<3,1>(0,2);//<sizeRows,sizeCols>(beginRow,beginCol)
-			solution = solution/solution[2];
+			double b = fabs((b1(0)*target(1) - b1(1)*target(0)) / determinant);
 
-			solution[1] = abs(solution[1]);
-			solution[0] = abs(solution[0]);
 			//check if integer combination of self, i.e. all elems close to zero
-			if ( ((solution[0]) < 0.03) && ((solution[1]) < 0.03) )
+			if ((a < 0.03) && (b < 0.03))
 				continue;
-			if ( ( (fmod(solution[0], 1) < 0.012) ||  (fmod(solution[0],1) > 0.988) ) &&
-					( (fmod(solution[1], 1) < 0.012) ||  (fmod(solution[1],1) > 0.988) ) )
+			if (isNearInteger(b))
 				return true;
 		}
 	}
@@ -731,6 +1397,12 @@ vector<Vector3d> LatticeDetector::getFinalBasisVectors(vector<Vector3d> const &c
 	vector<bool> valid(N);
 	std::fill(valid.begin(),valid.end(),true);
 
+	// the integer combination test runs in plane coordinates
+	vector<Vector2d> candidatesInOrder2d(N);
+	for (int i = 0; i < N; i++){
+		candidatesInOrder2d[i] = frame.directionToPlane(candidatesInOrder[i]);
+	}
+
 	for (int i=0; i<N;i++){
 		cout << candidatesInOrder[i] << endl;
 		cout <<"--"<<endl;
@@ -738,10 +1410,10 @@ vector<Vector3d> LatticeDetector::getFinalBasisVectors(vector<Vector3d> const &c
 
 	for (int i = 0; i < N; i++){
 
-		//1st check: if integer combination
-		if (N - (i+1) >= 2){
+		//1st check: if integer combination (skipped once the budget ran out, the candidates are then kept)
+		if ((N - (i+1) >= 2) && !budgetExhausted()){
 			bool a;
-			a = isIntegerCombination(i,candidatesInOrder,valid);
+			a = isIntegerCombination(i,candidatesInOrder2d,valid);
 			if (a){
 				valid.at(i) = false;
 				continue;
@@ -775,7 +1447,7 @@ vector<Vector3d> LatticeDetector::getFinalBasisVectors(vector<Vector3d> const &c
 
 
 	// Get the scores
-	vector<double> scoresInOrder = this->validateCandidateVectors(candidatesInOrder);
+	vector<double> scoresInOrder = this->validateCandidateVectors(candidatesInOrder, validityMode);
 
 	for (int i=0; i<N;i++){
 			cout << candidatesInOrder[i] << endl;
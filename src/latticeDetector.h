@@ -9,9 +9,17 @@
 #define SRC_LATTICEDETECTOR_H_
 
 #include <list>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
 #include <Eigen/Dense>
+#include <opencv2/core/core.hpp>
 
 #include "inputManager.h"
+#include "facadeRectifier.h"
+#include "planeFrame.h"
+#include "searchBudget.h"
 
 using namespace Eigen;
 using namespace std;
@@ -34,6 +42,68 @@ public:
 	 */
 	~LatticeDetector();
 
+	/*!
+	 * The ways to decide whether a grid point is valid, i.e. whether it looks like the reference point it is compared with.
+	 * SIFT_VALIDATION:		Compare SIFT descriptors in the most frontoparallel views (see arePointsValid).
+	 * RECTIFIED_VALIDATION:	Compare patches of the rectified facade texture of the plane with NCC (see FacadeRectifier). Falls back to
+	 * 							SIFT_VALIDATION if no view covers the plane.
+	 * OCCUPANCY_VALIDATION:	Geometry only: a grid point is valid if a point of the group lies within OCCUPANCY_TOLERANCE of it
+	 * 							(see isOccupied). No image is accessed, apart from the optional tie break (see setTieBreakValidityMode).
+	 */
+	enum ValidityMode{SIFT_VALIDATION, RECTIFIED_VALIDATION, OCCUPANCY_VALIDATION};
+
+	/*!
+	 * The ways to generate candidate basis vectors.
+	 * PAIRWISE_CANDIDATES:		All pairwise translations between the points, clustered and combined (see calculateCandidateVectors).
+	 * AUTOCORRELATION_CANDIDATES:	The dominant peaks of the 2D autocorrelation of the plane (see calculateAutocorrelationCandidateVectors).
+	 */
+	enum CandidateMode{PAIRWISE_CANDIDATES, AUTOCORRELATION_CANDIDATES};
+
+	/*!
+	 * Sets the way grid point validity is decided. Default is SIFT_VALIDATION.
+	 *
+	 * @param[in] mode	The validity mode.
+	 */
+	void setValidityMode(ValidityMode mode);
+
+	/*!
+	 * Sets the appearance validity mode used in OCCUPANCY_VALIDATION to break near-ties between the best scored candidate vectors:
+	 * the candidates whose occupancy score is within OCCUPANCY_TIE_RATIO of the best one (at most OCCUPANCY_SHORTLIST_SIZE) are ordered
+	 * by their score in that mode. Default is OCCUPANCY_VALIDATION, which disables the tie break (no image access at all). SIFT_VALIDATION
+	 * and RECTIFIED_VALIDATION load the images of the views that cover the plane.
+	 *
+	 * @param[in] mode	The validity mode of the tie break.
+	 */
+	void setTieBreakValidityMode(ValidityMode mode);
+
+	/*!
+	 * Sets the budget that limits the open-ended parts of the search (line expansions in validInvalidRatio and calculateLatticeBoundary,
+	 * candidate validation). When it is exhausted, these stop early and keep what was found so far. Default is NULL (unlimited).
+	 *
+	 * @param[in] aBudget	The budget, not owned by the detector. May be NULL.
+	 */
+	void setBudget(SearchBudget* aBudget);
+
+	/*!
+	 * Returns whether the budget ran out while candidate vectors were validated. The scores of the candidates are then means over the
+	 * reference points that were validated (scaled to all points), not sums over all of them.
+	 */
+	bool hasPartialScores() const;
+
+	/*!
+	 * Sets the number of threads of the parallel candidate validation. Set it to 1 when many detectors run concurrently, e.g. one per group.
+	 *
+	 * @param[in] aThreadCount	The number of threads, <= 0 for workerThreadCount() (default).
+	 */
+	void setThreadCount(int aThreadCount);
+
+	/*!
+	 * Returns the rectified facade texture of the plane, computing it on first use.
+	 *
+	 * @return	The rectifier of the plane, owned by the detector.
+	 */
+	FacadeRectifier const &getRectifiedFacade();
+
 	/*!
 	 * Calculates the candidate basis vectors for the given points. If naive is true, only the two candidate vectors that occurred most often are returned.
 	 *
@@ -42,6 +112,16 @@ public:
 	 */
 	vector<Vector3d> calculateCandidateVectors(bool naive);
 
+	/*!
+	 * Calculates candidate basis vectors from the dominant peaks of a 2D autocorrelation, computed with an FFT, instead of all pairwise translations.
+	 * If the rectified facade texture is used (RECTIFIED_VALIDATION with a covered plane), the autocorrelation of the texture is taken.
+	 * Otherwise the autocorrelation of a rasterized point-occupancy image of the points is taken, whose peaks are the frequent translations
+	 * between points. The cost is O(P log P) in the number of pixels P and does not depend on the number of points.
+	 *
+	 * @return	The candidate basis vectors, strongest autocorrelation peak first. Only one of two opposite translations is returned.
+	 */
+	vector<Vector3d> calculateAutocorrelationCandidateVectors();
+
 	/*!
 	 * Selects the best two basis vectors from a vector of candidates. A message is shown if not two vectors were found. Then the resulting vector will have < 2 entries, so an extra check outside the function must be made.
 	 *
@@ -53,6 +133,9 @@ public:
 	/*!
 	 * Calculates the lattice boundary in terms of corner, width and height.
 	 * The lattice is thought to span a parallelogram, originating at corner, with sides latticeVector1*width and latticeVector2*height
+	 * Grid points are compared with the point closest to the centroid. Starting from the window spanned by the on-grid points, the window
+	 * is expanded while its border lines are valid, and the validity of every grid point is computed only once. The boundary is the largest
+	 * rectangle in the window whose valid ratio, and the valid ratio of each of its border lines, is at least TRESHOLD2.
 	 *
 	 * @param[in] latticeVector1	The first basis vector of the lattice.
 	 * @param[in] latticeVector2	The second basis vector of the lattice.
@@ -70,11 +153,11 @@ public:
 	 * @param[in] inputIndices	The global indices (in terms of all model points) of the points the lattice was fit into.
 	 * @param[in] lattice		The lattice for wich the on grid points shall be determined. Note that the lattice needs to
 	 * 							have been generated with this LatticeDetector instance to achieve the desired behavior.
-	 * @return		A vector containing a pair of (global index, (i,j)-coordinates) for each on-grid point of the lattice.
+	 * @return		A LatticeGridIndex (global index, (i,j)-coordinates) for each on-grid point of the lattice.
 	 * 				The global index of such a point is its index in terms of all model points. The (i,j)-coordinates are integer-valued,
 	 * 				and determine the position of the corresponding lattice grid point, such that position = latticeCorner + i*latticeVector1 + j*latticeVector2.
 	 */
-	vector<pair<int,vector<int> > > getOnGridIndices(vector<int> const &inputIndices, LatticeStructure const &lattice);
+	vector<LatticeGridIndex> getOnGridIndices(vector<int> const &inputIndices, LatticeStructure const &lattice);
 
 	// GENERAL HELPER FUNCTION
 
@@ -114,6 +197,31 @@ public:
 
 	static constexpr double ANGLETRESHOLD = 0.0349;
 
+	static constexpr int AUTOCORRELATION_MAX_SIZE = 1024;	/*!< Maximum width and height of the (zero-padded) autocorrelation. Textures are
+																	downsampled until they fit. */
+
+	static constexpr int AUTOCORRELATION_MAX_CANDIDATES = 16;	/*!< Maximum number of autocorrelation peaks returned as candidate vectors. */
+
+	static constexpr double AUTOCORRELATION_PEAK_RATIO = 0.3;	/*!< Autocorrelation peaks weaker than this ratio of the strongest peak
+																	(apart from the zero shift) are discarded. */
+
+	static constexpr double AUTOCORRELATION_MIN_OVERLAP = 0.25;	/*!< For textures, shifts where the covered areas overlap by less than this ratio
+																	of the covered area are ignored, the normalized autocorrelation is too noisy there. */
+
+	static constexpr double OCCUPANCY_PIXEL_SIZE = VECTOR_DISTANCE / 3;	/*!< Pixel size of the rasterized point-occupancy image. */
+
+	static constexpr double OCCUPANCY_TOLERANCE = VECTOR_DISTANCE / 2;	/*!< In OCCUPANCY_VALIDATION, a grid point is valid if a point lies
+																				closer than this. Half the shortest basis vector, so a point
+																				can only occupy one grid point. */
+
+	static constexpr double OCCUPANCY_TIE_RATIO = 0.05;	/*!< Candidates whose occupancy score is within this ratio of the best score are tied. */
+
+	static constexpr int OCCUPANCY_SHORTLIST_SIZE = 4;	/*!< Maximum number of tied candidates that are compared by appearance. */
+
+	static constexpr int EXPANSION_BATCH_SIZE = 4;	/*!< Number of grid points that are validated together when a grid line is expanded
+															step by step (in validInvalidRatio). The expansion still stops at the same index,
+															at most EXPANSION_BATCH_SIZE-1 grid points are validated in vain. */
+
 private:
 
 	vector<Vector3d> points; 	/*!< The points to fit a lattice. All points lie on a plane. */
@@ -122,8 +230,41 @@ private:
 
 	Eigen::Vector4d plane; 		/*!< The plane all the points lie on. */
 
+	PlaneFrame frame;			/*!< The frame of the plane, centered at the centroid of the points. */
+
+	vector<Vector2d> points2d;	/*!< The points in 2d plane coordinates of frame, in the same order as points. All on-grid computations run on them. */
+
+	ValidityMode validityMode;	/*!< The way grid point validity is decided. */
+
+	ValidityMode tieBreakValidityMode;	/*!< The appearance validity mode that breaks ties in OCCUPANCY_VALIDATION. */
+
+	unordered_map<long long, vector<int> > occupancyGrid;	/*!< Indices into points2d, hashed by grid cells of size OCCUPANCY_TOLERANCE
+																(see gridCellKey). Built in the constructor, read-only afterwards. */
+
+	unique_ptr<FacadeRectifier> rectifiedFacade;	/*!< The rectified facade texture of the plane. NULL until first used. */
+
+	SearchBudget* budget;		/*!< The budget of the search, not owned. NULL for unlimited. */
+
+	int threadCount;			/*!< Threads of the parallel candidate validation, <= 0 for workerThreadCount(). */
+
+	bool partialScores;			/*!< Whether some (candidate vector, reference point) pairs were not validated, see hasPartialScores(). */
+
+	map<int, cv::Mat> imageCache;	/*!< Grayscale images that were already loaded for validation, per view. */
+
+	mutex cacheMutex;				/*!< Guards imageCache and referenceDescriptorCache, validation runs on several threads. */
+
+	mutex rectifierMutex;			/*!< Guards the creation of rectifiedFacade. */
+
+	map<vector<double>, VectorXd> referenceDescriptorCache;	/*!< SIFT descriptors of the reference points in their most frontoparallel view,
+																	per reference point coordinates. Empty if the reference point is not visible. */
+
 	// *** GENERAL HELPER FUNCTIONS
 
+	/*!
+	 * Returns whether a budget is set and exhausted.
+	 */
+	bool budgetExhausted();
+
 	/*!
 	 * Calculates the translation vector between two points
 	 *
@@ -138,12 +279,19 @@ private:
 
 	/*!
 	 * Clusters candidate vectors together that are similar. For a vector to be added to a cluster, it is enough if the vector is similar to one of the vectors in the cluster.
+	 * Candidates are bucketed into a grid in the plane and only compared with candidates in neighbouring cells, so the runtime is near-linear
+	 * in the number of candidates for spread out candidates.
 	 *
 	 * @param[in] candidates	Candidates to be clustered.
 	 * @return	A list of clusters, each cluster itself represented by a list of candidates.
 	 */
 	list<list<Vector3d> > clusterCandidates(vector<Vector3d> const &candidates);
 
+	/*!
+	 * Packs the integer coordinates of a grid cell into a single hash key.
+	 */
+	static long long gridCellKey(int x, int y);
+
 	/*!
 	 * Combines clustered candidates by averaging them to a single candidate vector and saves the original number of vectors in the cluster as a score for the
 	 * averaged candidate vector.  NOTE: This score is only important for the naive calculation of candidate vectors, where only the two most probable candidates
@@ -158,17 +306,51 @@ private:
 	void combineCandidates(list<list<Vector3d> > const &clusteredCandidates, vector<Vector3d> &combinedCandidates, vector<int> &scores);
 
 
+	/*! Image on a regular pixel grid in a plane, as input for the autocorrelation. Pixel (x,y) lies at plane coordinates origin + pixelSize*(x,y). */
+	struct PlaneRaster{
+		vector<double> values;		/*!< Pixel values, row-major. */
+		vector<double> weights;		/*!< Coverage of every pixel in [0,1]. Empty if every pixel counts. */
+		int width;
+		int height;
+		double pixelSize;
+		Vector2d origin;
+		PlaneFrame frame;
+	};
+
+	/*!
+	 * Rasterizes the rectified facade texture, downsampled to fit AUTOCORRELATION_MAX_SIZE, with zero mean over the covered pixels.
+	 */
+	PlaneRaster rasterizeTexture();
+
+	/*!
+	 * Rasterizes the points into a point-occupancy image with pixel size OCCUPANCY_PIXEL_SIZE. Every point is splatted bilinearly.
+	 */
+	PlaneRaster rasterizePoints();
+
+	/*!
+	 * Finds the dominant peaks of the autocorrelation of a raster, apart from the zero shift.
+	 *
+	 * @param[in] raster	The raster.
+	 * @return	The shifts of the peaks in pixels (sub-pixel refined), strongest first. Only shifts in one half-plane are returned.
+	 */
+	vector<Vector2d> autocorrelationPeaks(PlaneRaster const &raster);
+
+
 	// *** HELPER FUNCTIONS TO VALIDATE CANDIDATE VECTORS
 
 	/*!
 	 * Validates the candidate basis vectors. The higher the score, the more probable it is that the vector is true basis vector.
+	 * All (candidate vector, reference point) pairs are validated in parallel (see parallelFor), the scores are identical to a serial run.
+	 * The pairs are handed out point by point over all candidates. If the budget runs out, every candidate is scored by its mean ratio
+	 * over the pairs that were validated, scaled to the number of points, and hasPartialScores() is set.
 	 * @param[in] candidateVectors	The candidate vectors.
+	 * @param[in] mode				The validity mode to score them in, validityMode or tieBreakValidityMode.
 	 * @return	The score for every candidate vector.
 	 */
-	vector<double> validateCandidateVectors(vector<Vector3d> const &candidateVectors);
+	vector<double> validateCandidateVectors(vector<Vector3d> const &candidateVectors, ValidityMode mode);
 
 	/*!
-	 * Validates a candidate basis vector. The higher the score, the more probable it is that the vector is a true basis vector.
+	 * Validates a candidate basis vector, serially. The higher the score, the more probable it is that the vector is a true basis vector.
 	 *
 	 * @param[in]	candidateVector	The candidate basis vector.
 	 * @return	The score for the candidate basis vector.
@@ -180,18 +362,21 @@ private:
 	 *
 	 * @param[in] referencePoint	The reference point.
 	 * @param[in] candidateVector	The candidate basis vector.
+	 * @param[in] mode				The validity mode (see arePointsValid).
 	 * @return	The ratio of valid points to invalid points on the line.
 	 */
-	double validInvalidRatio(Vector3d const &referencePoint, Vector3d const &candidateVector);
+	double validInvalidRatio(Vector3d const &referencePoint, Vector3d const &candidateVector, ValidityMode mode);
 
 	/*!
 	 * Projects the points that the lattice was fit into onto the line through a reference point, in the direction of a candidate vector.
+	 * Works in 2d plane coordinates.
 	 *
-	 * @param[in] referencePoint	The reference point.
-	 * @param[in] candidateVector	The candidate vector.
-	 * @return	The projected points, lying on the line through the reference point in the direction of the candidate vector.
+	 * @param[in] referencePoint	The reference point, in plane coordinates.
+	 * @param[in] candidateVector	The candidate vector, in plane coordinates.
+	 * @return	For every point, the signed position of its projection on the line in multiples of the candidate vector:
+	 * 			projection = referencePoint + factor*candidateVector.
 	 */
-	vector<Vector3d> projectPointsOnLine(Vector3d const &referencePoint, Vector3d const &candidateVector);
+	vector<double> projectPointsOnLine(Vector2d const &referencePoint, Vector2d const &candidateVector);
 
 	/*!
 	 * Determines the outermost on-grid point indices (coordinates) for a given grid line; A grid line goes through a reference point and
@@ -200,87 +385,140 @@ private:
 	 * with to reach it. One of the points that the lattice shall be fit into is called "on-grid" if it is close to a grid point. The method returns
 	 * the outermost (minimum and maximum) indices of all grid points of the given grid line that have a close "on-grid" point.
 	 *
-	 * @param[in] projectedPoints	The projections of the points that the lattice shall be fit into onto the line through the reference point,
-	 * 								in the direction of the candidate vector.
-	 * @param[in] referencePoint	The reference point.
-	 * @param[in] candidateVector	The candidate vector.
+	 * @param[in] projectionFactors	The positions of the projections of the points that the lattice shall be fit into onto the line through the
+	 * 								reference point, in multiples of the candidate vector (see projectPointsOnLine).
+	 * @param[in] referencePoint	The reference point, in plane coordinates.
+	 * @param[in] candidateVector	The candidate vector, in plane coordinates.
 	 * @return	A vector containing the minimum and maximum on-grid point indices: [minIndex, maxIndex].
 	 */
-	vector<int> getOutermostOnGridPointIndices(vector<Vector3d> const &projectedPoints, Vector3d const &referencePoint, Vector3d const &candidateVector);
+	vector<int> getOutermostOnGridPointIndices(vector<double> const &projectionFactors, Vector2d const &referencePoint, Vector2d const &candidateVector);
 
 
 	/*!
-	* Checks whether the pointToTest is a valid lattice point, i.e.
-	* it's SIFT descriptor in the most frontoparallel view is 
-	* similar to the referencePoint's SIFT.
-	* calls the function computeSiftFronto, located in 3dtools.h.
-	*
-	* @param[in] referencePoint the 3D point from which the lattice expands
-	* @param[in] pointToTest    the 3D point to check if it belongs to the lattice
-	* return boolean variable according to whether the point is valid lattice point	
-	*/
-	bool isPointValid(Vector3d const &referencePoint, Vector3d const &pointToTest);
+	 * Checks for a set of points whether they are valid lattice points, i.e. whether their SIFT descriptor in the most frontoparallel view is
+	 * similar to the referencePoint's SIFT. The points are grouped by their most frontoparallel view, and all descriptors of one view are computed
+	 * with a single SIFT run (see computeSIFTBatch, located in 3dtools.h).
+	 * In RECTIFIED_VALIDATION mode, the patches around the points in the rectified facade texture are compared instead.
+	 * In OCCUPANCY_VALIDATION mode, a point is valid if a point of the group lies close to it (see isOccupied), the reference point is not used.
+	 *
+	 * @param[in] referencePoint	The 3D point from which the lattice expands.
+	 * @param[in] pointsToTest		The 3D points to check if they belong to the lattice.
+	 * @param[in] mode				The validity mode.
+	 * @return	For every point to test, whether it is a valid lattice point.
+	 */
+	vector<bool> arePointsValid(Vector3d const &referencePoint, vector<Vector3d> const &pointsToTest, ValidityMode mode);
+
+	/*!
+	 * Checks whether a point of the group lies closer than OCCUPANCY_TOLERANCE to a position on the plane, with the spatial hash of the points.
+	 * Only reads occupancyGrid, so it is safe to call from several threads without a lock.
+	 *
+	 * @param[in] point		The position, in plane coordinates.
+	 * @return	If true, the position is occupied by a point of the group.
+	 */
+	bool isOccupied(Vector2d const &point);
+
+	/*!
+	 * Orders near-tied candidate vectors by appearance, see setTieBreakValidityMode.
+	 *
+	 * @param[in] candidateVectors	The candidate vectors.
+	 * @param[in,out] scores		The occupancy scores. The tied candidates get the best score plus their appearance score divided by
+	 * 								the number of points plus one, so they stay above all other candidates.
+	 */
+	void breakTiesByAppearance(vector<Vector3d> const &candidateVectors, vector<double> &scores);
+
+	/*!
+	 * Returns the SIFT descriptor of a reference point in its most frontoparallel view. Descriptors are cached, as the same reference points
+	 * are used over and over again.
+	 *
+	 * @param[in] referencePoint	The reference point.
+	 * @param[in] rig				All the cameras in the dataset.
+	 * @return	The descriptor. Empty if the reference point is not visible in any considered view.
+	 */
+	VectorXd const &referenceDescriptor(Vector3d const &referencePoint, CameraRig const &rig);
+
+	/*!
+	 * Returns the grayscale image of a view, loading it on first use. Safe to call concurrently, the images are decoded outside the lock.
+	 *
+	 * @param[in] view	The view.
+	 * @return	The grayscale image of the view. Empty if it could not be read.
+	 */
+	cv::Mat const &getImage(int view);
+
+	/*!
+	 * Lists grid points on the grid line through an anchor point, in the direction of a direction vector.
+	 *
+	 * @param[in] anchorPoint		The anchor point, which is the grid point with index 0.
+	 * @param[in] directionVector	The direction vector. Grid points lie at integer multiples of it.
+	 * @param[in] firstIndex		The index of the first grid point to list.
+	 * @param[in] step				The index increment between two listed grid points (+1 or -1).
+	 * @param[in] count				The number of grid points to list.
+	 * @return	The grid points anchorPoint + directionVector*(firstIndex + k*step), for k = 0..count-1.
+	 */
+	vector<Vector3d> gridPointsOnLine(Vector3d const &anchorPoint, Vector3d const &directionVector, int firstIndex, int step, int count);
 
 /*!
-	* Checks whether the vector with index i is an integer combination of a subset of the vectors with index i+1:end.
+	* Checks whether the vector with index i is an integer combination of a pair of the vectors with index i+1:end.
+	* The coefficients of every pair are solved in closed form in the plane, without heap allocations. The second coefficient is
+	* only solved if the first one is an integer, and the test stops at the first pair that combines to the vector.
 	* @param[in] i index of the vector to test if it is an integer combination of the rest
-	* @param[in] candidatesInOrder    the set of vectors to check the co-linearity	
+	* @param[in] candidatesInOrder    the set of vectors to check the co-linearity, in plane coordinates
 	* @param[in] valid a validation index of each vector. Invalid the test vector will not be checked against invalid vectors
 	* return boolean if the vector is an int.comb.
 	*/
-	bool isIntegerCombination(int i,vector<Vector3d>& candidatesInOrder,vector<bool>& valid);
+	bool isIntegerCombination(int i, vector<Vector2d> const &candidatesInOrder, vector<bool> const &valid);
 
 
 	// *** HELPER FUNCTIONS TO GET LATTICE BOUNDARY
 
+	/*! Validity of grid cells, memoized while the lattice boundary is calculated. Cell (i,j) is the grid point anchor + i*vector1 + j*vector2,
+	 * it is valid if it looks like the anchor. */
+	struct CellValidityMemo{
+		Vector3d anchor;
+		Vector3d vector1;
+		Vector3d vector2;
+		map<pair<int,int>, bool> validity;
+	};
+
 	/*!
-	 * Calculates the lattice boundary in terms of corner, width and height, expanded around a certain reference point.
-	 * The lattice is thought to span a parallelogram, originating at corner, with sides latticeVector1*width and latticeVector2*height
+	 * Validates the cells that are not in the memo yet, all in one batch (see arePointsValid), and adds them to the memo.
 	 *
-	 * @param[in] referencePoint	The reference point around which the lattice boundary is expanded.
-	 * @param[in] latticeVector1	The first basis vector of the lattice.
-	 * @param[in] latticeVector2	The second basis vector of the lattice.
-	 * @param[out] cornerOut		The corner of the lattice.
-	 * @param[out] widthOut			The width of the lattice (in the direction of latticeVector1).
-	 * @param[out] heightOut		The height of the lattice (in the direction of latticeVector2).
+	 * @param[in,out] memo	The memo.
+	 * @param[in] cells		The cells (i,j) to validate.
 	 */
-	void latticeBoundaryForReferencePoint(Vector3d const &referencePoint, Vector3d const &latticeVector1, Vector3d const &latticeVector2, Vector3d &cornerOut, int &widthOut, int &heightOut);
+	void validateCells(CellValidityMemo &memo, vector<pair<int,int> > const &cells);
 
 	/*!
-	 * Determines whether a certain grid line (originating at anchorPoint, spanning in the direction of directionVector, for [length] steps)
-	 * is "valid", meaning that it contains a certain ratio of valid grid points. A grid point's validity is determined by comparing its appearance
-	 * to a reference point.
+	 * Calculates the ratio of valid cells on a grid line, validating the cells that are not in the memo yet.
 	 *
-	 * @param[in] referencePoint	The reference point. Grid points are compared with that reference point to determine whether they are valid or not.
-	 * @param[in] anchorPoint		The anchor point, which is the origin / start point of the grid line in examination.
-	 * @param[in] directionVector	The direction vector to build up the grid line originating at the anchor point. Grid points lie at
-	 * 									integer multiples of the direction vector.
-	 * @param[in] length			The length of the grid line in terms of direction vector multiples - the end of the grid is at anchorPoint+length*directionVector.
-	 * @return	If true, the line is considered valid.
+	 * @param[in,out] memo		The memo.
+	 * @param[in] i,j			The first cell of the line.
+	 * @param[in] stepI,stepJ	The index increment between two cells of the line.
+	 * @param[in] count			The number of cells on the line.
+	 * @return	The ratio of valid cells on the line.
 	 */
-	bool validLine(Vector3d const &referencePoint, Vector3d const &anchorPoint, Vector3d const &directionVector, int length);
+	double lineValidRatio(CellValidityMemo &memo, int i, int j, int stepI, int stepJ, int count);
 
 	/*!
 	 * Determines whether a point is close enough to a certain grid point to be called "on-grid". The additional vector is needed to
 	 * establish a proper treshold for the distance.
 	 *
-	 * @param[in] point		The point for which to decide whether it is "on-grid"
+	 * @param[in] point		The point for which to decide whether it is "on-grid", in plane coordinates.
 	 * @param[in] gridPoint	The grid point that the point should be checked against. If they are close enough, the point in question is called "on-grid".
 	 * @param[in] vector	A vector to establish a proper distance treshold based on which the "on-grid" decision is made. See implementation for details.
 	 * @return	If true, the point is called "on-grid". If false, the point is not considered to be "on-grid".
 	 */
-	bool pointEqualsGridPoint(Vector3d const &point, Vector3d const &gridPoint, Vector3d const &vector);
+	bool pointEqualsGridPoint(Vector2d const &point, Vector2d const &gridPoint, Vector2d const &vector);
 
 	// *** HELPER FUNCTIONS TO GET ON GRID POINTS
 
 	/*!
-	 * Changes the coordinate system for a set of points from canonical base to a base spanned by latticeVector1, latticeVector2 and latticeVector1xlatticeVector2
-	 * @param[in] points			Points for which the coordinate system should be changed.
-	 * @param[in] latticeVector1	Lattice vector 1.
-	 * @param[in] latticeVector2	Lattice vector 2.
+	 * Changes the coordinate system for a set of points from the plane frame to the basis spanned by latticeVector1 and latticeVector2.
+	 * @param[in] points			Points for which the coordinate system should be changed, in plane coordinates.
+	 * @param[in] latticeVector1	Lattice vector 1, in plane coordinates.
+	 * @param[in] latticeVector2	Lattice vector 2, in plane coordinates.
 	 * @return	The points in the lattice basis coordinate system.
 	 */
-	vector<Vector3d> changeToLatticeBasis(vector<Vector3d> const &points, Vector3d const &latticeVector1, Vector3d const &latticeVector2);
+	vector<Vector2d> changeToLatticeBasis(vector<Vector2d> const &points, Vector2d const &latticeVector1, Vector2d const &latticeVector2);
 
 };
 
@@ -0,0 +1,325 @@
+#ifndef LATTICESCHEDULER_H
+#define LATTICESCHEDULER_H
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+#include <exception>
+#include <chrono>
+#include <iostream>
+#include <sys/stat.h>
+
+#include "latticeClass.h"
+#include "latticeCache.h"
+#include "multiPlaneExtractor.h"
+#include "parallel.h"
+
+using namespace std;
+
+/*!< struct to report the lattice fit of one group */
+struct GroupFitReport
+{
+	int group = -1;					/*!< Index of the group. */
+	int plane = -1;					/*!< Index of the plane of the (group, plane) pair, -1 if the plane was fitted per group. */
+	int points = 0;					/*!< Number of points of the group. */
+	int planeInliers = 0;			/*!< Number of points on the plane. */
+	int onGridPoints = 0;			/*!< Number of points on the lattice grid. */
+	bool latticeFound = false;		/*!< Whether two basis vectors were found. */
+	bool failed = false;			/*!< Whether the fit threw. */
+	bool cached = false;			/*!< Whether the lattice was loaded from the cache instead of fitted. */
+	string error;					/*!< The message of the exception, if the fit threw. */
+	string file;					/*!< The file the lattice was saved to, empty if it was not saved. */
+	LatticeFitStats stats;			/*!< The statistics of the fit (time, candidate vectors, validated grid points, early stop). */
+};
+
+/**
+ * \class LatticeScheduler
+ *
+ *
+ * Fits the lattices of many groups concurrently on a pool of worker threads (see parallelFor). The groups are handed out largest first,
+ * so that a big group started last does not keep the others waiting. A group whose fit throws is reported as failed and does not affect
+ * the others. Every lattice is saved to outputDirectory as soon as its fit completed, so the results of a long run are kept if it is stopped.
+ * With a LatticeCache, the groups whose fit is cached are loaded instead, so a rerun only fits the groups whose inputs changed.
+ *
+ * Every group gets its own LatticeClass (and thus its own PlaneFitter and LatticeDetector), only the inputManager is shared, read-only.
+ * The detectors run their candidate validation single threaded while groups are fitted concurrently.
+ *
+ */
+class LatticeScheduler {
+
+public:
+
+	/*!
+	 * The constructor.
+	 *
+	 * @param[in] inpm				The input manager, shared read-only by all fits.
+	 * @param[in] aOutputDirectory	The directory the lattices are saved to (as lattice<group>.txt, or lattice<group>_<plane>.txt),
+	 * 								created if missing. Empty to not save them.
+	 * @param[in] aThreadCount		The number of groups fitted concurrently, <= 0 for workerThreadCount().
+	 */
+	LatticeScheduler(inputManager &inpm, string aOutputDirectory, int aThreadCount = 0){
+		inpM = &inpm;
+		outputDirectory = aOutputDirectory;
+		threadCount = (aThreadCount > 0) ? aThreadCount : workerThreadCount();
+	}
+
+	/*!
+	 * Sets the lattice that all lattices are configured from (validity and candidate modes, seed, budgets, cancellation token).
+	 * Its points are ignored.
+	 */
+	void setPrototype(LatticeClass const &aPrototype){
+		prototype.reset(new LatticeClass(aPrototype));
+	}
+
+	/*!
+	 * Sets the cache the fits are loaded from and stored to, NULL for none. Only the groups that are not cached are fitted.
+	 * The cache must outlive the scheduler.
+	 */
+	void setCache(LatticeCache *aCache){
+		cache = aCache;
+	}
+
+	/*!
+	 * Fits one lattice per group, with one plane per group.
+	 *
+	 * @param[in] groupsOfPoints		The 3d points of every group.
+	 * @param[in] groupsOfPointsIndices	The indices of the points of every group.
+	 * @return	The fitted lattices, in the order of the groups. Failed fits are left as unfitted lattices.
+	 */
+	vector<LatticeClass> fitGroups(vector<vector<Vector3d> > const &groupsOfPoints, vector<vector<int> > const &groupsOfPointsIndices){
+		vector<Job> jobs;
+		for (size_t g = 0; g < groupsOfPoints.size(); g++){
+			Job job;
+			job.group = g;
+			job.points = &groupsOfPoints[g];
+			job.indices = &groupsOfPointsIndices[g];
+			jobs.push_back(job);
+		}
+		return run(jobs);
+	}
+
+	/*!
+	 * Fits one lattice per (group, plane) pair, on the planes of a MultiPlaneExtractor.
+	 *
+	 * @param[in] groupPlanes	The (group, plane) pairs, see MultiPlaneExtractor::getGroupPlanes().
+	 * @param[in] planes		The planes, see MultiPlaneExtractor::getPlanes().
+	 * @return	The fitted lattices, in the order of the pairs. Failed fits are left as unfitted lattices.
+	 */
+	vector<LatticeClass> fitGroupPlanes(vector<GroupPlane> const &groupPlanes, vector<Vector4d> const &planes){
+		vector<Job> jobs;
+		for (size_t p = 0; p < groupPlanes.size(); p++){
+			Job job;
+			job.group = groupPlanes[p].group;
+			job.plane = groupPlanes[p].plane;
+			job.planeCoefficients = planes[groupPlanes[p].plane];
+			job.points = &groupPlanes[p].points;
+			job.indices = &groupPlanes[p].pointIndices;
+			jobs.push_back(job);
+		}
+		return run(jobs);
+	}
+
+	/*! Returns the reports of the last run, in the order of the returned lattices. */
+	vector<GroupFitReport> const &getReports() const{
+		return reports;
+	}
+
+	/*! Prints the reports of the last run, one line per group, and the totals. */
+	void printReports() const{
+		double totalSeconds = 0;
+		int found = 0;
+		int failed = 0;
+		int cached = 0;
+		for (size_t i = 0; i < reports.size(); i++){
+			printReport(reports[i]);
+			totalSeconds += reports[i].stats.seconds;
+			found += reports[i].latticeFound;
+			failed += reports[i].failed;
+			cached += reports[i].cached;
+		}
+		cout << reports.size() << " groups (" << cached << " cached), " << found << " lattices found, " << failed << " failed, " << totalSeconds
+				<< "s fitting time, " << wallSeconds << "s wall time on " << threadCount << " threads" << endl;
+	}
+
+private:
+
+	/*!< struct for one lattice fit to schedule */
+	struct Job
+	{
+		int group = -1;
+		int plane = -1;							/*!< -1 to fit the plane per group. */
+		Vector4d planeCoefficients = Vector4d::Zero();
+		vector<Vector3d> const *points = NULL;
+		vector<int> const *indices = NULL;
+	};
+
+	inputManager* inpM;
+
+	string outputDirectory;
+
+	int threadCount;
+
+	unique_ptr<LatticeClass> prototype;	/*!< The lattice the others are configured from, NULL for the defaults. */
+
+	LatticeCache *cache = NULL;			/*!< The cache of the fits, NULL for none. */
+
+	vector<GroupFitReport> reports;
+
+	double wallSeconds = 0;
+
+	mutex reportMutex;	/*!< Serializes the console output of the workers. */
+
+	/*! Fits all jobs, largest first, and collects the lattices and reports in the order of the jobs. */
+	vector<LatticeClass> run(vector<Job> const &jobs){
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		if (!outputDirectory.empty()){
+			mkdir(outputDirectory.c_str(), 0755);
+		}
+
+		// largest groups first
+		vector<int> order(jobs.size());
+		iota(order.begin(), order.end(), 0);
+		stable_sort(order.begin(), order.end(), [&](int a, int b) { return jobs[a].points->size() > jobs[b].points->size(); });
+
+		vector<unique_ptr<LatticeClass> > lattices(jobs.size());
+		reports = vector<GroupFitReport>(jobs.size());
+
+		parallelFor(jobs.size(), [&](int k){
+			int j = order[k];
+			lattices[j] = fitJob(jobs[j], reports[j]);
+		}, threadCount);
+
+		wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		vector<LatticeClass> result;
+		result.reserve(jobs.size());
+		for (size_t j = 0; j < jobs.size(); j++){
+			// a job that failed before its lattice was created is left as an empty, unfitted lattice
+			if (!lattices[j]){
+				vector<Vector3d> noPoints;
+				vector<int> noIndices;
+				lattices[j].reset(new LatticeClass(*inpM, noPoints, noIndices));
+			}
+			result.push_back(std::move(*lattices[j]));
+		}
+		return result;
+	}
+
+	/*! Fits, saves and reports one job. Never throws. Returns NULL if the lattice could not even be created. */
+	unique_ptr<LatticeClass> fitJob(Job const &job, GroupFitReport &report){
+
+		report.group = job.group;
+		report.plane = job.plane;
+		report.points = job.points->size();
+
+		unique_ptr<LatticeClass> lattice;
+
+		try{
+			vector<Vector3d> points = *job.points;
+			vector<int> indices = *job.indices;
+
+			lattice.reset(new LatticeClass(*inpM, points, indices));
+			if (prototype){
+				configure(*lattice);
+			}
+			if (threadCount > 1){
+				lattice->detectorThreads = 1;
+			}
+
+			uint64_t cacheKey = 0;
+			if (cache != NULL){
+				cacheKey = cache->key(*lattice, (job.plane >= 0) ? &job.planeCoefficients : NULL);
+				report.cached = cache->load(cacheKey, *lattice);
+			}
+
+			if (!report.cached){
+				if (job.plane >= 0){
+					lattice->fitLattice(job.planeCoefficients);
+				}
+				else{
+					lattice->fitLattice();
+				}
+				if (cache != NULL){
+					cache->store(cacheKey, *lattice);
+				}
+			}
+
+			report.planeInliers = lattice->planeInlierIdx.size();
+			report.onGridPoints = lattice->latticeGridIndices.size();
+			report.latticeFound = (lattice->LattStructure.basisVectors.size() == 2);
+
+			if (!outputDirectory.empty()){
+				report.file = outputDirectory + "/lattice" + to_string(job.group) + ((job.plane >= 0) ? "_" + to_string(job.plane) : "") + ".txt";
+				lattice->saveLatticeToFile(report.file.c_str());
+			}
+		}
+		catch (exception const &e){
+			report.failed = true;
+			report.error = e.what();
+		}
+		catch (...){
+			report.failed = true;
+			report.error = "unknown exception";
+		}
+		if (lattice){
+			report.stats = lattice->fitStats;
+		}
+
+		{
+			lock_guard<mutex> lock(reportMutex);
+			printReport(report);
+		}
+
+		return lattice;
+	}
+
+	/*! Copies the configuration of the prototype to a lattice. */
+	void configure(LatticeClass &lattice) const{
+		lattice.validityMode = prototype->validityMode;
+		lattice.tieBreakValidityMode = prototype->tieBreakValidityMode;
+		lattice.candidateMode = prototype->candidateMode;
+		lattice.ransacSeed = prototype->ransacSeed;
+		lattice.timeBudgetSeconds = prototype->timeBudgetSeconds;
+		lattice.stepBudget = prototype->stepBudget;
+		lattice.cancellationToken = prototype->cancellationToken;
+		lattice.detectorThreads = prototype->detectorThreads;
+	}
+
+	/*! Prints the report of one group in one line. */
+	static void printReport(GroupFitReport const &report){
+		cout << "group " << report.group;
+		if (report.plane >= 0){
+			cout << " plane " << report.plane;
+		}
+		cout << ": " << report.points << " points, " << report.planeInliers << " on plane, "
+				<< report.stats.candidateVectors << " candidate vectors, " << report.stats.validatedGridPoints << " validated grid points, "
+				<< report.stats.seconds << "s";
+		if (report.stats.stopReason != SearchBudget::NOT_STOPPED){
+			cout << ", stopped early (" << (report.stats.stopReason == SearchBudget::CANCELLED ? "cancelled" :
+					(report.stats.stopReason == SearchBudget::TIME_BUDGET ? "time budget" : "step budget")) << ")";
+			if (report.stats.partialScores){
+				cout << ", partial candidate scores";
+			}
+		}
+		if (report.cached){
+			cout << ", cached";
+		}
+		if (report.failed){
+			cout << ", FAILED: " << report.error;
+		}
+		else if (report.latticeFound){
+			cout << ", lattice with " << report.onGridPoints << " on-grid points";
+		}
+		else{
+			cout << ", no lattice";
+		}
+		cout << endl;
+	}
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include <Eigen/Dense>
 #include <vector>
 #include <math.h>
+#include <stdint.h>
 
 using namespace std;
 
@@ -48,11 +49,53 @@ struct TriangulatedPoint
 }; // end struct TriangulatedPoint
 
 
+/*!< struct for a 3d point on a lattice grid point: the index of the point (in inputManager.pointModel) and the grid coordinates (i,j),
+ * i in the direction of basisVectors[0], j in the direction of basisVectors[1]. Plain data, 8 bytes, no heap allocation. */
+struct LatticeGridIndex
+{
+	int pointId;
+	int16_t i;
+	int16_t j;
+};
+
+/*!< struct for the basis vectors of a lattice, stored in place: a lattice has two of them, or less while it is not found (yet).
+ * Has the parts of the std::vector interface that are used for basis vectors. */
+struct LatticeBasis
+{
+	Eigen::Vector3d vectors[2];
+	int count = 0;
+
+	LatticeBasis(){}
+
+	/*! Takes the first (at most) two vectors. */
+	LatticeBasis(std::vector<Eigen::Vector3d> const &v){
+		*this = v;
+	}
+
+	/*! Takes the first (at most) two vectors. */
+	LatticeBasis &operator=(std::vector<Eigen::Vector3d> const &v){
+		count = 0;
+		for (size_t k = 0; (k < v.size()) && (k < 2); k++){
+			vectors[count++] = v[k];
+		}
+		return *this;
+	}
+
+	size_t size() const { return count; }
+	void clear() { count = 0; }
+	void push_back(Eigen::Vector3d const &v) { if (count < 2) vectors[count++] = v; }
+	Eigen::Vector3d &operator[](int k) { return vectors[k]; }
+	Eigen::Vector3d const &operator[](int k) const { return vectors[k]; }
+
+	/*! Returns the vectors as std::vector, for the interfaces that take one. */
+	std::vector<Eigen::Vector3d> toVector() const { return std::vector<Eigen::Vector3d>(vectors, vectors + count); }
+};
+
 /*!< struct to keep the lattice's geometric properties: the plane as 4d vector, the 2 basis vectors, the width and height, i.e. the number of basis vectors to translate to reach the lattice limit, starting from the lower left corner (corner field).*/
 struct LatticeStructure
 {
 	Eigen::Vector4d plane;
-	std::vector<Eigen::Vector3d> basisVectors;
+	LatticeBasis basisVectors;
 	int width; // in the direction of basisVectors[0]
 	int height; // in the direction of basisVectors[1]
 	Eigen::Vector3d corner;
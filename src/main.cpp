@@ -18,6 +18,9 @@
 #include "3dtools.h"
 #include "inputManager.h"
 #include "latticeClass.h"
+#include "multiPlaneExtractor.h"
+#include "latticeScheduler.h"
+#include "overlayRenderer.h"
 
 #include "BundleOptimizer.h"
 
@@ -79,34 +82,12 @@ void readFromFile(vector<T>& resvec, int fieldsize, const char* filename){
 
 
 float calculateReprojectionError(inputManager inpM){
-	Vector2f pa;
-	CameraMatrix cam;
-	cam.setIntrinsic(inpM.getK());
-
-	float reprojectionError = 0;
-
-	for (int pointidx=0; pointidx < inpM.getPoints().size(); pointidx++){
-
-		for (int j=0; j<inpM.getPointModel()[pointidx].measurements.size();j++){
-			int imgview = inpM.getPointModel()[pointidx].measurements[j].view;
-
-			int i=0;
-			for (i=0;i<inpM.getCamPoses().size();i++){
-				if (inpM.getViewIds()[i] == imgview)
-					break;
-			}
-			Eigen::Matrix<double,3,4> P = inpM.getCamPoses()[i];
-			cam.setOrientation(P);
-			pa = cam.projectPoint(inpM.getPointModel()[pointidx].pos).cast<float>();
-
-			float err = (pa - inpM.getPointModel()[pointidx].measurements[j].pos).norm();
-			//if (err > 50)
-			//	err = 50;
-			reprojectionError += err;
-		}
+	vector<int> pointIndices(inpM.pointModel.size());
+	for (size_t pointidx=0; pointidx < pointIndices.size(); pointidx++){
+		pointIndices[pointidx] = pointidx;
 	}
 
-	return reprojectionError;
+	return inpM.reprojectionError(pointIndices);
 }
 
 void outputDistanceVectors(string filename, const vector<Vector3d> &allModelPoints, bool outputWidth){
@@ -170,11 +151,12 @@ int main(int argc, char** argv)
 {
 	cv::initModule_nonfree();
     // check argc
-    if(argc != 5)
+    if((argc != 5) && !((argc == 6) && (string(argv[5]) == "--fit-lattices")))
     {
-        cout << "Usage: ./latt_bal images.txt points.txt cams.txt K.txt" << endl;
+        cout << "Usage: ./latt_bal images.txt points.txt cams.txt K.txt [--fit-lattices]" << endl;
         return -1;
     }
+    bool fitLattices = (argc == 6);	// refit the lattices of all groups instead of loading the selected ones
 
     // -----------------------------------------------------------------------
     // REPETITIVE POINTS
@@ -220,26 +202,65 @@ int main(int argc, char** argv)
 	 *		allLattices.push_back(mylatt);
 	 *
 	 * }
+	 *
+	 * With --fit-lattices, the planes of all groups are extracted at once instead, and a lattice is fitted to every (group, plane) pair.
      */
 
 
     int validlattices[] = {0,8 ,11,13,17,31, 33}; //10?14?26?34? //27,31 has 3points | and 18 ofc
 
 	vector<LatticeClass> allLattices;
-	cout << "importing lattices" << endl;
 
-	for (size_t i=0;i<7; i++) {
+	if (fitLattices) {
+
+		// extract the planes of all groups at once, so a group spanning several facades is split into one (group, plane) pair per facade
+		cout << "extracting planes" << endl;
+		MultiPlaneExtractor planeExtractor;
+		planeExtractor.extract(groupsOfPoints, groupsOfPointsIndices);
+
+		// fit all (group, plane) pairs concurrently, the lattices are saved as they complete. Pairs fitted by an earlier run with
+		// the same inputs are loaded from the cache instead.
+		cout << "fitting lattices" << endl;
+		LatticeCache cache(inpM, "./data/latticeCache");
+		LatticeScheduler scheduler(inpM, "./data/fittedLattices");
+		scheduler.setCache(&cache);
+		vector<LatticeClass> fittedLattices = scheduler.fitGroupPlanes(planeExtractor.getGroupPlanes(), planeExtractor.getPlanes());
+		scheduler.printReports();
+		cout << cache.getHits() << " lattices loaded from the cache, " << cache.getMisses() << " fitted" << endl;
+
+		// overlays of the found lattices for review, written offscreen, named as the saved lattices
+		vector<GroupFitReport> const &reports = scheduler.getReports();
+		OverlayRenderer overlayRenderer(inpM, "./data/overlays");
+		for (size_t i=0;i<fittedLattices.size(); i++) {
+			if (fittedLattices[i].LattStructure.basisVectors.size() == 2) {
+				overlayRenderer.addLattice(fittedLattices[i], "lattice"+to_string(reports[i].group)+"_"+to_string(reports[i].plane));
+			}
+		}
+		overlayRenderer.render();
 
-		int v = validlattices[i];
-		string filename = "./data/savedLattices/lattice"+to_string(v)+".txt";
-		LatticeClass mylatt(inpM,groupsOfPoints[v],groupsOfPointsIndices[v],filename.c_str());
-		allLattices.push_back(mylatt);
+		for (size_t i=0;i<fittedLattices.size(); i++) {
+			if (fittedLattices[i].LattStructure.basisVectors.size() == 2) {
+				allLattices.push_back(std::move(fittedLattices[i]));
+			}
+		}
+	}
+	else {
+
+		cout << "importing lattices" << endl;
 
+		for (size_t i=0;i<7; i++) {
+
+			int v = validlattices[i];
+			string filename = "./data/savedLattices/lattice"+to_string(v)+".txt";
+			LatticeClass mylatt(inpM,groupsOfPoints[v],groupsOfPointsIndices[v],filename.c_str());
+			allLattices.push_back(std::move(mylatt));
+
+		}
 	}
 
 	int size = allLattices.size();
 
-	list<list<LatticeClass> > consolidatedLattices = LatticeClass::consolidateLattices(allLattices);
+	ConsolidatedLattices consolidatedLattices = LatticeClass::consolidateLattices(std::move(allLattices));
 
 	// -----------------------------------------------------------------------
 	// BUNDLE ADJUSTMENT OPTIMIZATION
@@ -272,11 +293,13 @@ int main(int argc, char** argv)
 	// read out optimized values
 	inpM.updatePointsWithModel();
 	inpM.setCamPoses(bal.getOptimizedCameras());
-	bal.readoutLatticeParameters(consolidatedLattices);
-	//bal.readoutRigidLatticeParameters(consolidatedLattices);
+	bal.readoutLatticeParameters();
+	//bal.readoutRigidLatticeParameters();
 
 	outputCostsInConsole(bal);
 
+	LatticeClass::printCopyStatistics();
+
 	vector<Vector3d> allModelPoints = inpM.getPoints();
 
 	outputDistanceVectors("./data/distanceVectors/width_vectors_"+to_string(gridTransformationWeight)+"_"+to_string(basisVectorWeight)+".txt", allModelPoints, true);
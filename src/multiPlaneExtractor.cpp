@@ -0,0 +1,270 @@
+#include "multiPlaneExtractor.h"
+
+#include <iostream>
+#include <algorithm>
+#include <math.h>
+
+constexpr double MultiPlaneExtractor::PLANE_THRESHOLD;
+constexpr int MultiPlaneExtractor::BLOCK_SIZE;
+
+MultiPlaneExtractor::MultiPlaneExtractor(unsigned int seed) : generator(seed)
+{
+}
+
+int MultiPlaneExtractor::extract(vector<vector<Vector3d> > const &groupsOfPoints, vector<vector<int> > const &groupsOfPointsIndices)
+{
+	groupPoints = groupsOfPoints;
+	groupPointIndices = groupsOfPointsIndices;
+	planes.clear();
+	planeIds = vector<vector<int> >(groupsOfPoints.size());
+	groupMembers = vector<vector<int> >(groupsOfPoints.size());
+
+	// flatten the points of all groups
+	int count = 0;
+	for (size_t g = 0; g < groupsOfPoints.size(); g++)
+	{
+		count += groupsOfPoints[g].size();
+		planeIds[g] = vector<int>(groupsOfPoints[g].size(), -1);
+	}
+
+	xs = ArrayXd(count);
+	ys = ArrayXd(count);
+	zs = ArrayXd(count);
+	pointGroup = vector<int>(count);
+	pointInGroup = vector<int>(count);
+
+	int k = 0;
+	for (size_t g = 0; g < groupsOfPoints.size(); g++)
+	{
+		for (size_t i = 0; i < groupsOfPoints[g].size(); i++)
+		{
+			xs(k) = groupsOfPoints[g][i](0);
+			ys(k) = groupsOfPoints[g][i](1);
+			zs(k) = groupsOfPoints[g][i](2);
+			pointGroup[k] = g;
+			pointInGroup[k] = i;
+			groupMembers[g].push_back(k);
+			k++;
+		}
+	}
+
+	vector<int> remaining(count);
+	for (int i = 0; i < count; i++)
+	{
+		remaining[i] = i;
+	}
+
+	// sequential RANSAC: extract the best plane, remove its inliers, repeat
+	while (((int)remaining.size() >= MIN_PLANE_INLIERS) && ((int)planes.size() < MAX_PLANES))
+	{
+		Vector4d plane;
+		int inliers = findBestPlane(remaining, plane);
+		if (inliers < MIN_PLANE_INLIERS)
+		{
+			break;
+		}
+
+		// refit the plane to all its inliers, and assign them to it
+		PlaneAccumulator accumulator;
+		for (size_t r = 0; r < remaining.size(); r++)
+		{
+			int i = remaining[r];
+			Vector3d point(xs(i), ys(i), zs(i));
+			if (fabs(plane.head<3>().dot(point) + plane(3)) < PLANE_THRESHOLD)
+			{
+				accumulator.add(point);
+			}
+		}
+		accumulator.getPlane(plane);
+
+		int planeId = planes.size();
+		vector<int> stillRemaining;
+		int assigned = 0;
+		for (size_t r = 0; r < remaining.size(); r++)
+		{
+			int i = remaining[r];
+			if (fabs(plane(0)*xs(i) + plane(1)*ys(i) + plane(2)*zs(i) + plane(3)) < PLANE_THRESHOLD)
+			{
+				planeIds[pointGroup[i]][pointInGroup[i]] = planeId;
+				assigned++;
+			}
+			else
+			{
+				stillRemaining.push_back(i);
+			}
+		}
+
+		if (assigned < MIN_PLANE_INLIERS)
+		{
+			// the refit drifted away from its inliers, undo
+			for (size_t r = 0; r < remaining.size(); r++)
+			{
+				int i = remaining[r];
+				if (planeIds[pointGroup[i]][pointInGroup[i]] == planeId)
+				{
+					planeIds[pointGroup[i]][pointInGroup[i]] = -1;
+				}
+			}
+			break;
+		}
+
+		planes.push_back(plane);
+		remaining.swap(stillRemaining);
+
+		cout << "plane " << planeId << ": " << assigned << " inliers, " << remaining.size() << " points remaining" << endl;
+	}
+
+	return planes.size();
+}
+
+int MultiPlaneExtractor::findBestPlane(vector<int> const &remaining, Vector4d &plane)
+{
+	int N = remaining.size();
+
+	// compact copy of the remaining points, so every hypothesis is scored vectorized against all groups at once
+	ArrayXd rx(N), ry(N), rz(N);
+	vector<vector<int> > remainingByGroup(groupMembers.size());
+	for (int r = 0; r < N; r++)
+	{
+		int i = remaining[r];
+		rx(r) = xs(i);
+		ry(r) = ys(i);
+		rz(r) = zs(i);
+		remainingByGroup[pointGroup[i]].push_back(r);
+	}
+
+	// the minimal samples are drawn within one group, if a group still has enough points
+	vector<int> samplable;
+	for (size_t g = 0; g < remainingByGroup.size(); g++)
+	{
+		if (remainingByGroup[g].size() >= 3)
+		{
+			samplable.insert(samplable.end(), remainingByGroup[g].begin(), remainingByGroup[g].end());
+		}
+	}
+
+	uniform_int_distribution<int> anyPoint(0, N-1);
+
+	int bestInlNum = 0;
+	double maxIterations = MAX_ITERATIONS;
+
+	for (int iter = 0; iter < maxIterations; iter++)
+	{
+		int sample[3];
+		if (!samplable.empty())
+		{
+			sample[0] = samplable[uniform_int_distribution<int>(0, samplable.size()-1)(generator)];
+			vector<int> const &members = remainingByGroup[pointGroup[remaining[sample[0]]]];
+			uniform_int_distribution<int> member(0, members.size()-1);
+			for (int s = 1; s < 3; s++)
+			{
+				int x;
+				do{
+					x = members[member(generator)];
+				}while (find(sample, sample+s, x) != sample+s);
+				sample[s] = x;
+			}
+		}
+		else
+		{
+			for (int s = 0; s < 3; s++)
+			{
+				int x;
+				do{
+					x = anyPoint(generator);
+				}while (find(sample, sample+s, x) != sample+s);
+				sample[s] = x;
+			}
+		}
+
+		Vector3d p0(rx(sample[0]), ry(sample[0]), rz(sample[0]));
+		Vector3d p1(rx(sample[1]), ry(sample[1]), rz(sample[1]));
+		Vector3d p2(rx(sample[2]), ry(sample[2]), rz(sample[2]));
+		Vector3d normal = (p1 - p0).cross(p2 - p0);
+		double normalLength = normal.norm();
+		if (normalLength < 1e-12)
+		{
+			continue;	// collinear sample
+		}
+		normal = normal / normalLength;
+		double offset = -normal.dot(p0);
+
+		// score in blocks, and stop once the hypothesis cannot beat the best one anymore
+		int inl_num = 0;
+		int tested = 0;
+		while (tested < N)
+		{
+			int blockSize = min(BLOCK_SIZE, N - tested);
+			ArrayXd distances = rx.segment(tested, blockSize)*normal(0) + ry.segment(tested, blockSize)*normal(1)
+					+ rz.segment(tested, blockSize)*normal(2) + offset;
+			inl_num += (distances.abs() < PLANE_THRESHOLD).count();
+			tested += blockSize;
+
+			if (inl_num + (N - tested) <= bestInlNum)
+			{
+				break;
+			}
+		}
+
+		if (inl_num > bestInlNum)
+		{
+			bestInlNum = inl_num;
+			plane << normal, offset;
+
+			double allInlierProbability = pow((double)bestInlNum/N, 3);
+			if (allInlierProbability >= 1)
+			{
+				break;
+			}
+			double testIterations = log(1-CONFIDENCE)/log(1-allInlierProbability);
+			maxIterations = min((double)MAX_ITERATIONS, max((double)MIN_ITERATIONS, testIterations));
+		}
+	}
+
+	return bestInlNum;
+}
+
+vector<Vector4d> const &MultiPlaneExtractor::getPlanes() const
+{
+	return planes;
+}
+
+vector<vector<int> > const &MultiPlaneExtractor::getPlaneIds() const
+{
+	return planeIds;
+}
+
+vector<GroupPlane> MultiPlaneExtractor::getGroupPlanes() const
+{
+	vector<GroupPlane> groupPlanes;
+
+	for (size_t g = 0; g < planeIds.size(); g++)
+	{
+		vector<GroupPlane> pairs(planes.size());
+		for (size_t p = 0; p < planes.size(); p++)
+		{
+			pairs[p].group = g;
+			pairs[p].plane = p;
+		}
+
+		for (size_t i = 0; i < planeIds[g].size(); i++)
+		{
+			int p = planeIds[g][i];
+			if (p >= 0)
+			{
+				pairs[p].points.push_back(groupPoints[g][i]);
+				pairs[p].pointIndices.push_back(groupPointIndices[g][i]);
+			}
+		}
+
+		for (size_t p = 0; p < pairs.size(); p++)
+		{
+			if ((int)pairs[p].points.size() >= MIN_GROUP_PLANE_POINTS)
+			{
+				groupPlanes.push_back(pairs[p]);
+			}
+		}
+	}
+
+	return groupPlanes;
+}
@@ -0,0 +1,114 @@
+#ifndef MULTIPLANEEXTRACTOR_H
+#define MULTIPLANEEXTRACTOR_H
+
+#include <vector>
+#include <random>
+#include <Eigen/Dense>
+
+#include "planeFitter.h"
+
+using namespace Eigen;
+using namespace std;
+
+/*!< struct for the points of one group that lie on one plane, the input of one lattice fit */
+struct GroupPlane
+{
+	int group;					/*!< Index of the group. */
+	int plane;					/*!< Index of the plane in MultiPlaneExtractor::getPlanes(). */
+	vector<Vector3d> points;	/*!< The points of the group on the plane. */
+	vector<int> pointIndices;	/*!< Their indices (pointing the initial dataset, inputManager.pointModel). */
+};
+
+/**
+ * \class MultiPlaneExtractor
+ *
+ *
+ * This class extracts all planes from the points of all groups at once, by sequential RANSAC: the plane with the largest support over the
+ * points of all groups is found, its inliers are removed, and this is repeated until no plane has enough support.
+ * A group can therefore be split over several planes (e.g. points of windows on perpendicular faces of a building, see README_Notes, note 6),
+ * and a plane found once is shared by all groups on it, instead of fitting one plane per group. Every hypothesis is scored once against the
+ * points of all groups.
+ *
+ * The minimal samples are drawn within one group, since points of one group are close to each other and more likely on one plane.
+ * The result is a plane id for every point, and the (group, plane) pairs to fit lattices on.
+ *
+ */
+class MultiPlaneExtractor {
+
+public:
+
+	static constexpr double PLANE_THRESHOLD = 0.006;		/*!< Maximum point-plane distance of an inlier, as in PlaneFitter. */
+
+	static constexpr int MIN_PLANE_INLIERS = 6;			/*!< Planes with less inliers are not extracted. */
+
+	static constexpr int MIN_GROUP_PLANE_POINTS = 3;	/*!< (group, plane) pairs with less points are not returned. */
+
+	static constexpr int MAX_PLANES = 64;				/*!< Upper bound of extracted planes. */
+
+	static constexpr int MAX_ITERATIONS = 2000;			/*!< Upper bound of RANSAC iterations per plane. */
+
+	static constexpr int MIN_ITERATIONS = 50;			/*!< Lower bound of RANSAC iterations per plane. */
+
+	static constexpr double CONFIDENCE = 0.99;			/*!< Probability to draw at least one all-inlier sample (adaptive termination). */
+
+	static constexpr int BLOCK_SIZE = 256;				/*!< Points tested between two early rejection checks. */
+
+	/*!
+	 * The constructor.
+	 *
+	 * @param[in] seed	The seed of the generator the RANSAC samples are drawn from. The same seed and input give the same planes.
+	 */
+	MultiPlaneExtractor(unsigned int seed = PlaneFitter::DEFAULT_SEED);
+
+	/*!
+	 * Extracts the planes from the points of all groups.
+	 *
+	 * @param[in] groupsOfPoints		The 3d points of every group.
+	 * @param[in] groupsOfPointsIndices	The indices of the points of every group (pointing the initial dataset, inputManager.pointModel).
+	 * @return	The number of extracted planes.
+	 */
+	int extract(vector<vector<Vector3d> > const &groupsOfPoints, vector<vector<int> > const &groupsOfPointsIndices);
+
+	/*! Returns the extracted planes (a,b,c,d), with (a,b,c) of unit length, ordered by decreasing support. */
+	vector<Vector4d> const &getPlanes() const;
+
+	/*! Returns for every group and every point of it the index of its plane, or -1 if it is on none. */
+	vector<vector<int> > const &getPlaneIds() const;
+
+	/*!
+	 * Returns the points of every group split by plane, ordered by group and then by plane. Pairs with less than
+	 * MIN_GROUP_PLANE_POINTS points are left out.
+	 */
+	vector<GroupPlane> getGroupPlanes() const;
+
+private:
+
+	/*!
+	 * Finds the plane with the largest support among the remaining points.
+	 *
+	 * @param[in] remaining	The indices of the remaining points in the flattened arrays.
+	 * @param[out] plane		The best plane, with a normal of unit length.
+	 * @return	The number of inliers of the best plane.
+	 */
+	int findBestPlane(vector<int> const &remaining, Vector4d &plane);
+
+	mt19937 generator;		/*!< The generator the RANSAC samples are drawn from. */
+
+	ArrayXd xs, ys, zs;		/*!< Coordinates of the points of all groups, flattened (structure of arrays). */
+
+	vector<int> pointGroup;	/*!< Group of every flattened point. */
+
+	vector<int> pointInGroup;	/*!< Index of every flattened point within its group. */
+
+	vector<vector<int> > groupMembers;	/*!< Flattened indices of the points of every group. */
+
+	vector<vector<Vector3d> > groupPoints;	/*!< The input points, per group. */
+
+	vector<vector<int> > groupPointIndices;	/*!< The input point indices, per group. */
+
+	vector<Vector4d> planes;	/*!< The extracted planes. */
+
+	vector<vector<int> > planeIds;	/*!< Plane of every point of every group, -1 for none. */
+};
+
+#endif
@@ -0,0 +1,260 @@
+#include "overlayRenderer.h"
+
+#include <iostream>
+#include <math.h>
+#include <sys/stat.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "parallel.h"
+
+// the colors of the CImg visualizations (RGB), in OpenCV's BGR order
+static const cv::Scalar LATTICE_COLOR = cv::Scalar(255,0,0);
+static const cv::Scalar MEASUREMENT_COLOR = cv::Scalar(0,255,0);
+static const cv::Scalar CORNER_COLOR = cv::Scalar(0,0,255);
+
+static cv::Point toPixel(Vector2d const &p)
+{
+	return cv::Point((int)lround(p(0)), (int)lround(p(1)));
+}
+
+OverlayRenderer::OverlayRenderer(inputManager &inpm, string aOutputDirectory, int aThreadCount, int aCacheSize)
+{
+	inpM = &inpm;
+	outputDirectory = aOutputDirectory;
+	threadCount = (aThreadCount > 0) ? aThreadCount : workerThreadCount();
+	cacheSize = aCacheSize;
+}
+
+void OverlayRenderer::addLattice(LatticeClass const &lattice, string name, int view, bool debug)
+{
+	Overlay overlay;
+	overlay.view = (view >= 0) ? view : firstView(lattice);
+	overlay.file = name + ".png";
+	overlay.lattices.push_back(&lattice);
+	overlay.group = &lattice;
+	overlay.drawGroup = true;
+	overlay.debug = debug;
+	overlays.push_back(overlay);
+}
+
+void OverlayRenderer::addLattices(vector<LatticeClass> const &lattices, string name, int view)
+{
+	if (lattices.empty())
+	{
+		return;
+	}
+	Overlay overlay;
+	overlay.view = (view >= 0) ? view : firstView(lattices[0]);
+	overlay.file = name + ".png";
+	for (size_t l = 0; l < lattices.size(); l++)
+	{
+		overlay.lattices.push_back(&lattices[l]);
+	}
+	overlays.push_back(overlay);
+}
+
+void OverlayRenderer::addGroup(LatticeClass const &lattice, string name)
+{
+	if (lattice.groupPointsIdx.empty())
+	{
+		return;
+	}
+	TriangulatedPoint const &firstPoint = inpM->pointModel[lattice.groupPointsIdx[0]];
+	for (size_t m = 0; m < firstPoint.measurements.size(); m++)
+	{
+		Overlay overlay;
+		overlay.view = firstPoint.measurements[m].view;
+		overlay.file = name + "_view" + to_string(overlay.view) + ".png";
+		overlay.group = &lattice;
+		overlay.drawGroup = true;
+		overlay.drawMeasurements = true;
+		overlays.push_back(overlay);
+	}
+}
+
+int OverlayRenderer::queued() const
+{
+	return overlays.size();
+}
+
+int OverlayRenderer::render()
+{
+	if (!outputDirectory.empty())
+	{
+		mkdir(outputDirectory.c_str(), 0755);
+	}
+
+	// one worker per view, so every image is decoded once
+	map<int, vector<int> > overlaysOfView;
+	for (size_t o = 0; o < overlays.size(); o++)
+	{
+		overlaysOfView[overlays[o].view].push_back(o);
+	}
+	vector<pair<int, vector<int> > > views(overlaysOfView.begin(), overlaysOfView.end());
+
+	vector<int> written(views.size(), 0);
+
+	parallelFor(views.size(), [&](int v){
+		int view = views[v].first;
+		shared_ptr<cv::Mat const> image = getImage(view);
+		if (!image)
+		{
+			return;
+		}
+		for (size_t o = 0; o < views[v].second.size(); o++)
+		{
+			written[v] += renderOverlay(overlays[views[v].second[o]], *image);
+		}
+	}, threadCount);
+
+	int total = 0;
+	for (size_t v = 0; v < written.size(); v++)
+	{
+		total += written[v];
+	}
+	cout << "wrote " << total << " of " << overlays.size() << " overlays to " << outputDirectory << endl;
+
+	overlays.clear();
+	return total;
+}
+
+shared_ptr<cv::Mat const> OverlayRenderer::getImage(int view)
+{
+	{
+		lock_guard<mutex> lock(cacheMutex);
+		map<int, shared_ptr<cv::Mat const> >::iterator cached = imageCache.find(view);
+		if (cached != imageCache.end())
+		{
+			cacheOrder.remove(view);
+			cacheOrder.push_back(view);
+			return cached->second;
+		}
+	}
+
+	vector<string> imageNames = inpM->getImgNames();
+	if (view < 0 || view >= (int)imageNames.size() || inpM->getCameraRig()->cameraOfView(view) < 0)
+	{
+		cout << "no image or camera for view " << view << endl;
+		return shared_ptr<cv::Mat const>();
+	}
+
+	// decoded outside the lock, the views of one render() are decoded concurrently
+	shared_ptr<cv::Mat const> image(new cv::Mat(cv::imread("data/" + imageNames[view])));
+	if (image->empty())
+	{
+		cout << "could not read data/" << imageNames[view] << endl;
+		return shared_ptr<cv::Mat const>();
+	}
+
+	lock_guard<mutex> lock(cacheMutex);
+	if (cacheSize > 0)
+	{
+		imageCache[view] = image;
+		cacheOrder.remove(view);
+		cacheOrder.push_back(view);
+		while ((int)cacheOrder.size() > cacheSize)
+		{
+			imageCache.erase(cacheOrder.front());
+			cacheOrder.pop_front();
+		}
+	}
+	return image;
+}
+
+int OverlayRenderer::firstView(LatticeClass const &lattice) const
+{
+	if (lattice.groupPointsIdx.empty())
+	{
+		return -1;
+	}
+	TriangulatedPoint const &firstPoint = inpM->pointModel[lattice.groupPointsIdx[0]];
+	if (firstPoint.measurements.empty())
+	{
+		return -1;
+	}
+	return firstPoint.measurements[0].view;
+}
+
+bool OverlayRenderer::renderOverlay(Overlay const &overlay, cv::Mat const &baseImage)
+{
+	cv::Mat image = baseImage.clone();
+
+	shared_ptr<CameraRig const> rig = inpM->getCameraRig();
+	int camera = rig->cameraOfView(overlay.view);
+	CameraMatrix const &cam = rig->camera(camera);
+
+	if (overlay.drawGroup && overlay.group != NULL)
+	{
+		LatticeClass const &group = *overlay.group;
+		int radius = overlay.drawMeasurements ? 5 : 4;
+		for (size_t k = 0; k < group.groupPointsIdx.size(); k++)
+		{
+			TriangulatedPoint const &point = inpM->pointModel[group.groupPointsIdx[k]];
+			cv::circle(image, toPixel(cam.projectPoint(point.pos)), radius, LATTICE_COLOR, -1);
+
+			if (overlay.drawMeasurements)
+			{
+				// nominal position (from the SIFT feature)
+				for (size_t q = 0; q < point.measurements.size(); q++)
+				{
+					if (point.measurements[q].view == overlay.view)
+					{
+						cv::circle(image, toPixel(point.measurements[q].pos.cast<double>()), 5, MEASUREMENT_COLOR, -1);
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	for (size_t l = 0; l < overlay.lattices.size(); l++)
+	{
+		drawGrid(image, cam, camera, *overlay.lattices[l], overlay.debug);
+	}
+
+	string file = outputDirectory.empty() ? overlay.file : outputDirectory + "/" + overlay.file;
+	if (!cv::imwrite(file, image))
+	{
+		cout << "could not write " << file << endl;
+		return false;
+	}
+	return true;
+}
+
+void OverlayRenderer::drawGrid(cv::Mat &image, CameraMatrix const &cam, int camera, LatticeClass const &lattice, bool debug)
+{
+	LatticeStructure const &latt = lattice.LattStructure;
+	if (latt.basisVectors.size() != 2)
+	{
+		return;
+	}
+
+	// grid points are projected with the homography of the grid into the camera
+	GridHomography const &homography = lattice.getGridHomographies()->cameras()[camera];
+	double depth;
+
+	int k1 = latt.width;
+	int k2 = latt.height;
+
+	// lines along basis1, one per row
+	for (int k = 0; k <= k2; k++)
+	{
+		cv::line(image, toPixel(homography.project(0, k, depth)), toPixel(homography.project(k1, k, depth)), LATTICE_COLOR);
+	}
+
+	// lines along basis2, one per column
+	for (int k = 0; k <= k1; k++)
+	{
+		cv::line(image, toPixel(homography.project(k, 0, depth)), toPixel(homography.project(k, k2, depth)), LATTICE_COLOR);
+	}
+
+	if (debug)
+	{
+		cv::circle(image, toPixel(homography.project(0, 0, depth)), 6, CORNER_COLOR, -1);
+		for (size_t j = 0; j < lattice.latticeGridIndices.size(); j++)
+		{
+			cv::circle(image, toPixel(cam.projectPoint(lattice.inpM->pointModel[lattice.latticeGridIndices[j].pointId].pos)), 3, LATTICE_COLOR, -1);
+		}
+	}
+}
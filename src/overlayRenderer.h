@@ -0,0 +1,128 @@
+#ifndef OVERLAYRENDERER_H
+#define OVERLAYRENDERER_H
+
+#include <vector>
+#include <map>
+#include <list>
+#include <string>
+#include <mutex>
+#include <memory>
+#include <Eigen/Dense>
+#include <opencv2/core/core.hpp>
+
+#include "latticeClass.h"
+
+using namespace Eigen;
+using namespace std;
+
+/**
+ * \class OverlayRenderer
+ *
+ *
+ * Renders lattice and group overlays offscreen and writes them as PNG files, the headless counterpart of LatticeClass::projectLatticeToImage,
+ * projectMultipleLatticesToImage and projectGroupToImage (same views, colors and markers). No display is opened, so it runs without an X server.
+ * The images are read and written with opencv_highgui (see LATT_HEADLESS in CMakeLists.txt for what that still links).
+ *
+ * Overlays are queued with the add methods and written by render(). The overlays are rendered in parallel, one worker per view, so every
+ * image is decoded once per render(); decoded images are kept in a cache of cacheSize images for later calls.
+ * The queued lattices are referenced, not copied: they must outlive the next render().
+ *
+ */
+class OverlayRenderer {
+
+public:
+
+	static constexpr int DEFAULT_CACHE_SIZE = 8;	/*!< Default number of decoded images kept between calls of render(). */
+
+	/*!
+	 * The constructor.
+	 *
+	 * @param[in] inpm				The input manager (image names, cameras, points).
+	 * @param[in] aOutputDirectory	The directory the PNG files are written to, created if missing.
+	 * @param[in] aThreadCount		The number of views rendered concurrently, <= 0 for workerThreadCount().
+	 * @param[in] aCacheSize		The number of decoded images kept between calls of render().
+	 */
+	OverlayRenderer(inputManager &inpm, string aOutputDirectory, int aThreadCount = 0, int aCacheSize = DEFAULT_CACHE_SIZE);
+
+	/*!
+	 * Queues the overlay of a lattice and its group points, as projectLatticeToImage.
+	 *
+	 * @param[in] lattice	The lattice, with two basis vectors.
+	 * @param[in] name		The name of the file, without directory and extension.
+	 * @param[in] view		The view to draw on, -1 for the first view the first point of the group is visible in.
+	 * @param[in] debug		Whether to mark the corner and the on-grid points as well.
+	 */
+	void addLattice(LatticeClass const &lattice, string name, int view = -1, bool debug = false);
+
+	/*!
+	 * Queues the overlay of the grids of many lattices on one image, as projectMultipleLatticesToImage.
+	 *
+	 * @param[in] lattices	The lattices, with two basis vectors each.
+	 * @param[in] name		The name of the file, without directory and extension.
+	 * @param[in] view		The view to draw on, -1 for the first view the first point of the first lattice is visible in.
+	 */
+	void addLattices(vector<LatticeClass> const &lattices, string name, int view = -1);
+
+	/*!
+	 * Queues the overlays of a group, one per view its first point is visible in, as projectGroupToImage: the projected points
+	 * and their measured positions. The files are named <name>_view<view>.
+	 *
+	 * @param[in] lattice	The lattice of the group.
+	 * @param[in] name		The prefix of the file names, without directory.
+	 */
+	void addGroup(LatticeClass const &lattice, string name);
+
+	/*!
+	 * Renders and writes all queued overlays, and clears the queue.
+	 *
+	 * @return	The number of files written.
+	 */
+	int render();
+
+	/*! Returns the number of queued overlays. */
+	int queued() const;
+
+private:
+
+	/*!< struct for one queued overlay */
+	struct Overlay
+	{
+		int view = -1;
+		string file;
+		vector<LatticeClass const *> lattices;	/*!< The lattices whose grids are drawn. */
+		LatticeClass const *group = NULL;		/*!< The lattice whose group points are drawn, NULL for none. */
+		bool drawGroup = false;					/*!< Whether the group points are drawn (as projectLatticeToImage). */
+		bool drawMeasurements = false;			/*!< Whether the measured positions of the group points are drawn too (as projectGroupToImage). */
+		bool debug = false;						/*!< Whether the corner and the on-grid points are marked. */
+	};
+
+	inputManager* inpM;
+
+	string outputDirectory;
+
+	int threadCount;
+
+	int cacheSize;
+
+	vector<Overlay> overlays;
+
+	mutex cacheMutex;
+
+	map<int, shared_ptr<cv::Mat const> > imageCache;	/*!< Decoded images, by view. */
+
+	list<int> cacheOrder;				/*!< Views of the cached images, least recently used first. */
+
+	/*! Returns the decoded image of a view from the cache, or decodes and caches it. NULL if it cannot be read. */
+	shared_ptr<cv::Mat const> getImage(int view);
+
+	/*! Returns the first view the first point of the lattice's group is visible in, -1 if there is none. */
+	int firstView(LatticeClass const &lattice) const;
+
+	/*! Draws one overlay on a copy of the image of its view and writes it. Returns whether the file was written. */
+	bool renderOverlay(Overlay const &overlay, cv::Mat const &image);
+
+	/*! Draws the grid lines of a lattice into the image of a camera, with the grid homography of the camera (see LatticeClass::getGridHomographies). */
+	static void drawGrid(cv::Mat &image, CameraMatrix const &cam, int camera, LatticeClass const &lattice, bool debug);
+};
+
+#endif
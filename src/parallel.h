@@ -0,0 +1,97 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <mutex>
+#include <system_error>
+
+using namespace std;
+
+/*!
+ * Returns the number of worker threads to use, i.e. the number of hardware threads (at least 1).
+ */
+inline int workerThreadCount()
+{
+    int count = thread::hardware_concurrency();
+    return (count > 0) ? count : 1;
+}
+
+/*!
+ * Calls body(i) for every i in [0,count) on a pool of worker threads. The indices are handed out dynamically one by one,
+ * so tasks of very different cost are balanced. Returns when all calls returned. The body must be thread-safe.
+ * If a call throws, the remaining indices are skipped, all threads are joined and the first exception is rethrown on the calling thread.
+ *
+ * @param[in] count the number of indices
+ * @param[in] body the function to call for every index
+ * @param[in] threadCount the number of worker threads, the calling thread is one of them. Default: workerThreadCount()
+ */
+inline void parallelFor(int count, function<void(int)> const &body, int threadCount = 0)
+{
+    if (threadCount <= 0)
+    {
+        threadCount = workerThreadCount();
+    }
+    if (threadCount > count)
+    {
+        threadCount = count;
+    }
+
+    atomic<int> nextIndex(0);
+
+    // the first exception thrown by a call, rethrown once all threads are joined
+    exception_ptr firstException;
+    mutex exceptionMutex;
+
+    auto worker = [&]()
+    {
+        try
+        {
+            for (int i = nextIndex++; i < count; i = nextIndex++)
+            {
+                body(i);
+            }
+        }
+        catch (...)
+        {
+            lock_guard<mutex> lock(exceptionMutex);
+            if (!firstException)
+            {
+                firstException = current_exception();
+            }
+            // no further indices are handed out
+            nextIndex = count;
+        }
+    };
+
+    vector<thread> threads;
+    for (int t = 1; t < threadCount; t++)
+    {
+        try
+        {
+            threads.push_back(thread(worker));
+        }
+        catch (system_error const &)
+        {
+            // no more threads available, the ones started so far do the work
+            break;
+        }
+    }
+
+    worker();
+
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        threads[t].join();
+    }
+
+    if (firstException)
+    {
+        rethrow_exception(firstException);
+    }
+}
+
+#endif
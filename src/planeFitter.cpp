@@ -8,100 +8,208 @@
 #include "planeFitter.h"
 
 #include <iostream>
+#include <algorithm>
+#include <math.h>
 
 using namespace std;
 
-PlaneFitter::PlaneFitter() {
-	this->fittedplane = new Eigen::Vector4d();
-	this->Dinliers = new Eigen::Matrix<double,4,Eigen::Dynamic>(4,1); //dummy initialization
+constexpr int PlaneFitter::RANSAC_BLOCK_SIZE;
+
+PlaneFitter::PlaneFitter(unsigned int seed) : generator(seed) {
+	this->fittedplane = Eigen::Vector4d::Zero();
+	this->Dinliers = Eigen::Matrix<double,4,Eigen::Dynamic>(4,0);
+	this->numberOfInliers = 0;
+}
+
+PlaneFitter::PlaneFitter(std::mt19937 const &aGenerator) : generator(aGenerator) {
+	this->fittedplane = Eigen::Vector4d::Zero();
+	this->Dinliers = Eigen::Matrix<double,4,Eigen::Dynamic>(4,0);
+	this->numberOfInliers = 0;
 }
 
 PlaneFitter::~PlaneFitter() {
-	delete this->fittedplane;
-	delete this->Dinliers;
+}
+
+void PlaneFitter::setSeed(unsigned int seed){
+	this->generator.seed(seed);
 }
 
 Eigen::Vector4d PlaneFitter::getFittedPlane() const{
-	return *this->fittedplane;
+	return this->fittedplane;
 }
 
 Eigen::Matrix<double,4,Eigen::Dynamic> PlaneFitter::getInlierPoints() const{
-	return *this->Dinliers;
+	return this->Dinliers;
 }
 
-std::vector<int> PlaneFitter::ransacFit(std::vector<Eigen::Vector3d> points3d, std::vector<int> inputIndices){
+std::vector<int> PlaneFitter::ransacFit(std::vector<Eigen::Vector3d> const &points3d, std::vector<int> const &inputIndices){
 
-	Eigen::Matrix<double,4,Eigen::Dynamic> D(4,points3d.size());
-	this->vecToEigenMat(points3d,D);
+	int N = points3d.size();
 
-	int N = D.cols();
+	// The points are tested in blocks, and the SPRT assumes that every block is a random sample of the points.
+	// The input order is not random (e.g. a group spanning two facades), so the points are shuffled once, with the seeded generator.
+	std::vector<int> order(N);
+	for (int i=0;i<N;i++){
+		order[i] = i;
+	}
+	std::shuffle(order.begin(), order.end(), this->generator);
+
+	// structure-of-arrays layout in shuffled order, so the inlier test runs vectorized over all points
+	Eigen::ArrayXd xs(N), ys(N), zs(N);
+	for (int i=0;i<N;i++){
+		xs(i) = points3d[order[i]](0);
+		ys(i) = points3d[order[i]](1);
+		zs(i) = points3d[order[i]](2);
+	}
 
 	// RANSAC variables
-	float p = 0.99;
-	float testRansiter = 0;
+	float p = RANSAC_CONFIDENCE;
+	double maxIterations = RANSAC_MAX_ITERATIONS;
 	int bestInlNum = 0;
 	int best_it=-1;
-	int inl_num;
-	srand (time(NULL));
-	Eigen::Vector4d *testplane = new Eigen::Vector4d();
+	Eigen::Vector4d bestplane = Eigen::Vector4d::Zero();
+	std::uniform_int_distribution<int> sampleDistribution(0, std::max(N-1, 0));
 
+	// SPRT: probability that a point is an inlier to a bad model, estimated from the rejected models
+	double delta = SPRT_INITIAL_DELTA;
+	long rejectedPoints = 0;
+	long rejectedInliers = 0;
 
-	//keep the indices of the final inliers
-	std::vector<int> bestInlierIds;
+	long pointEvaluations = 0;
 
 	// RANSAC loop
-	for (int iter=0;iter<2000;iter++){
+	int iter;
+	for (iter=0; (iter<maxIterations) && (N>=3); iter++){
 
 		//sample 3 different random points
-		std::vector<int> samplevec;
-		Eigen::Matrix<double,3,4> D_ransac_sample;
-		int x;
+		int sample[3];
 		for (int s=0; s<3; s++){
+			int x;
 			do{
-				x = rand() % N;
-			}while (std::find(samplevec.begin(), samplevec.end(), x) != samplevec.end());
-			samplevec.push_back(x);
-			D_ransac_sample.block<1,4>(s,0) = D.block<4,1>(0,x).transpose();//<sizeRows,sizeCols>(beginRow,beginCol)
+				x = sampleDistribution(this->generator);
+			}while (std::find(sample, sample+s, x) != sample+s);
+			sample[s] = x;
 		}
 
-		//fit model
-		this->fitPlane(D_ransac_sample,testplane);
-
-		std::vector<int> inl_id;
-		//inlier test
-		inl_num = 0;
-		for (int i=0;i<N;i++){
-			if ( abs(D.block<4,1>(0,i).dot(*testplane)/testplane->head(3).norm()) < this->RANSAC_THRESH ){
-				inl_num++;
-				inl_id.push_back(i);
+		//fit model, pre-normalized: normal of unit length, so the dot product is the point-plane distance
+		Eigen::Vector3d p0 = points3d[sample[0]];
+		Eigen::Vector3d normal = (points3d[sample[1]] - p0).cross(points3d[sample[2]] - p0);
+		double normalLength = normal.norm();
+		if (normalLength < 1e-12){
+			continue;	// collinear sample
+		}
+		normal = normal / normalLength;
+		double offset = -normal.dot(p0);
+
+		// inlier test in blocks. After every block, reject the model early if
+		// - it cannot beat the best model anymore, even if all remaining points are inliers, or
+		// - the SPRT likelihood ratio of "bad model" vs "model as good as the best one" exceeds SPRT_THRESHOLD.
+		double epsilon = (double)bestInlNum/N;
+		bool sprtActive = (bestInlNum > 0) && (epsilon > delta);
+		double logInlier = sprtActive ? log(delta/epsilon) : 0;
+		double logOutlier = sprtActive ? log((1-delta)/(1-epsilon)) : 0;
+
+		int inl_num = 0;
+		int tested = 0;
+		bool rejected = false;
+
+		while (tested < N){
+			int blockSize = std::min(RANSAC_BLOCK_SIZE, N - tested);
+			Eigen::ArrayXd distances = xs.segment(tested, blockSize)*normal(0) + ys.segment(tested, blockSize)*normal(1)
+					+ zs.segment(tested, blockSize)*normal(2) + offset;
+			inl_num += (distances.abs() < this->RANSAC_THRESH).count();
+			tested += blockSize;
+
+			if (inl_num + (N - tested) <= bestInlNum){
+				rejected = true;
+				break;
+			}
+			if (sprtActive && (inl_num*logInlier + (tested - inl_num)*logOutlier > SPRT_THRESHOLD)){
+				rejected = true;
+				break;
 			}
 		}
 
-		//cout << "iter,inliers: " << iter <<","<<inl_num<< endl;
+		pointEvaluations += tested;
+
+		if (rejected){
+			rejectedPoints += tested;
+			rejectedInliers += inl_num;
+			if (rejectedPoints >= RANSAC_BLOCK_SIZE){
+				delta = std::max(SPRT_INITIAL_DELTA*0.1, (double)rejectedInliers/rejectedPoints);
+			}
+			continue;
+		}
 
-		//test (adaptive ransac)
-		testRansiter = log(1-p)/log(1-pow((float)inl_num/N,3));
 		if (inl_num > bestInlNum){
 			bestInlNum = inl_num;
 			best_it = iter;
-			bestInlierIds.swap(inl_id);
+			bestplane << normal, offset;
+
+			// local optimization: refit the new best model to its inliers, minimal samples are noisy. Only done for new best models.
+			for (int refinement=0; refinement<RANSAC_LOCAL_REFINEMENTS; refinement++){
+				Eigen::ArrayXd distances = xs*bestplane(0) + ys*bestplane(1) + zs*bestplane(2) + bestplane(3);
+				PlaneAccumulator accumulator;
+				for (int i=0; i<N; i++){
+					if (abs(distances(i)) < this->RANSAC_THRESH){
+						accumulator.add(Eigen::Vector3d(xs(i), ys(i), zs(i)));
+					}
+				}
+				Eigen::Vector4d refinedplane;
+				if (!accumulator.getPlane(refinedplane)){
+					break;
+				}
+
+				Eigen::ArrayXd refinedDistances = xs*refinedplane(0) + ys*refinedplane(1) + zs*refinedplane(2) + refinedplane(3);
+				int refinedInlNum = (refinedDistances.abs() < this->RANSAC_THRESH).count();
+				pointEvaluations += 2*N;
+
+				if (refinedInlNum <= bestInlNum){
+					break;
+				}
+				bestInlNum = refinedInlNum;
+				bestplane = refinedplane;
+			}
+
+			//test (adaptive ransac): iterations needed to draw an all-inlier sample with probability p
+			double inlierRatio = (double)bestInlNum/N;
+			double allInlierProbability = pow(inlierRatio,3);
+			if (allInlierProbability >= 1){
+				maxIterations = 0;
+			}
+			else if (allInlierProbability > 0){
+				double testRansiter = log(1-p)/log(1-allInlierProbability);
+				maxIterations = std::min((double)RANSAC_MAX_ITERATIONS, std::max((double)RANSAC_MIN_ITERATIONS, testRansiter));
+			}
 		}
+	}
 
+	// materialize the inliers of the winning model only
+	std::vector<int> bestInlierIds;
+	bestInlierIds.reserve(bestInlNum);
+	if (bestInlNum > 0){
+		Eigen::ArrayXd distances = xs*bestplane(0) + ys*bestplane(1) + zs*bestplane(2) + bestplane(3);
+		for (int i=0;i<N;i++){
+			if (abs(distances(i)) < this->RANSAC_THRESH){
+				bestInlierIds.push_back(order[i]);
+			}
+		}
+		// back to the input order
+		std::sort(bestInlierIds.begin(), bestInlierIds.end());
 	}
 
 	// bestplane contains the fitted plane
-	cout << "best iter,inliers: " << best_it <<","<<bestInlNum<< endl;
+	cout << "best iter,inliers: " << best_it <<","<<bestInlNum<< " (" << iter << " iterations, " << pointEvaluations << " point evaluations)" << endl;
 
 
-	// before computing the new plane, delete the old results 
-	// (for the case of one single planeFitter object for computing multiple planes)
-	delete this->Dinliers;
-	delete this->fittedplane;
-
+	// overwrite the old results (for the case of one single planeFitter object for computing multiple planes)
 	this->numberOfInliers = bestInlNum;
-	this->Dinliers = new Eigen::Matrix<double,4,Eigen::Dynamic>(4,bestInlNum);
+	this->Dinliers.resize(4,bestInlNum);
 
-	this->vecToEigenMat(points3d,*this->Dinliers,bestInlierIds);
+	// an empty id vector would mean all points
+	if (bestInlNum > 0){
+		this->vecToEigenMat(points3d,this->Dinliers,bestInlierIds);
+	}
 
 	// get the indices of the inlier points for the output
 	vector<int> outputIndices;
@@ -109,33 +217,62 @@ std::vector<int> PlaneFitter::ransacFit(std::vector<Eigen::Vector3d> points3d, s
 		outputIndices.push_back(inputIndices[bestInlierIds[i]]);
 	}
 
-	// Refine best plane with all the inliers.
-	this->fitPlane(Dinliers->transpose(),testplane);
+	// Refine best plane with all the inliers, robustly weighted.
+	this->fittedplane = bestplane;
+	refinePlaneIRLS(this->Dinliers, this->fittedplane, this->RANSAC_THRESH, IRLS_ITERATIONS);
 
-	this->fittedplane = new Eigen::Vector4d();
-	this->fittedplane = testplane;
 	return outputIndices;
 }
 
 
-void PlaneFitter::fitPlane(Eigen::Matrix<double,Eigen::Dynamic,4> Points,Eigen::Vector4d *plane){
+bool PlaneFitter::fitPlane(Eigen::Matrix<double,Eigen::Dynamic,4> const &Points,Eigen::Vector4d &plane){
+
+	PlaneAccumulator accumulator;
+	for (int i=0; i<Points.rows(); i++){
+		accumulator.add(Points.block<1,3>(i,0).transpose()/Points(i,3));
+	}
+	return accumulator.getPlane(plane);
+}
 
-	Eigen::JacobiSVD<Eigen::MatrixXd> svd(Points, Eigen::ComputeThinU | Eigen::ComputeFullV);
-	*plane = svd.matrixV().block<4,1>(0,3);//<sizeRows,sizeCols>(beginRow,beginCol)
+bool PlaneFitter::fitPlaneWeighted(Eigen::Matrix<double,4,Eigen::Dynamic> const &Points, Eigen::VectorXd const &weights, Eigen::Vector4d &plane){
 
-	return;
+	PlaneAccumulator accumulator;
+	for (int i=0; i<Points.cols(); i++){
+		accumulator.add(Points.block<3,1>(0,i)/Points(3,i), weights(i));
+	}
+	return accumulator.getPlane(plane);
+}
+
+void PlaneFitter::refinePlaneIRLS(Eigen::Matrix<double,4,Eigen::Dynamic> const &Points, Eigen::Vector4d &plane, double scale, int iterations){
+
+	if (plane.head<3>().squaredNorm() == 0){
+		return;
+	}
+	plane = plane / plane.head<3>().norm();
+
+	for (int iteration=0; iteration<iterations; iteration++){
+		Eigen::VectorXd residuals = (plane.transpose()*Points).transpose();
+		Eigen::VectorXd weights = (1. + (residuals.array()/scale).square()).inverse().matrix();
+
+		Eigen::Vector4d refinedplane;
+		if (!fitPlaneWeighted(Points, weights, refinedplane)){
+			return;
+		}
+		plane = refinedplane;
+	}
 }
 
-std::vector<Eigen::Vector3d> PlaneFitter::getProjectedInliers(){
+std::vector<Eigen::Vector3d> PlaneFitter::getProjectedInliers() const{
 		vector<Eigen::Vector3d> latticePoints;
-		Eigen::Matrix<double,4,Eigen::Dynamic> Dbest = *this->Dinliers;
-		Eigen::Vector4d bestplane = *this->fittedplane;
+		latticePoints.reserve(this->Dinliers.cols());
+		Eigen::Matrix<double,4,Eigen::Dynamic> const &Dbest = this->Dinliers;
+		Eigen::Vector4d const &bestplane = this->fittedplane;
 		for (int i=0; i<Dbest.cols(); i++){
 			Eigen::Vector3d p = Dbest.block<3,1>(0,i);
 			float dist = p.dot(bestplane.head<3>()) + bestplane(3);
 			//cout << dist << endl;
 
-			p = p - bestplane.head<3>()*(dist)/sqrt(bestplane.head<3>().squaredNorm());
+			p = p - bestplane.head<3>()*(dist)/bestplane.head<3>().squaredNorm();
 			latticePoints.push_back(p);
 		}
 		return latticePoints;
@@ -10,6 +10,54 @@
 
 #include <Eigen/Dense>
 #include <vector>
+#include <random>
+
+/*!< struct to accumulate (weighted) points in one streaming pass, and to fit the least squares plane to them:
+ * the plane goes through the weighted centroid, and its normal is the eigenvector of the smallest eigenvalue of the 3x3 covariance.
+ * The points are accumulated relative to the first point, so that large coordinates do not cancel out. */
+struct PlaneAccumulator
+{
+	double weightSum = 0;					/*!< Sum of the weights. */
+	int count = 0;							/*!< Number of points with positive weight. */
+	Eigen::Vector3d shift = Eigen::Vector3d::Zero();		/*!< The first point, all points are accumulated relative to it. */
+	Eigen::Vector3d sum = Eigen::Vector3d::Zero();			/*!< Weighted sum of the shifted points. */
+	Eigen::Matrix3d outerSum = Eigen::Matrix3d::Zero();		/*!< Weighted sum of the outer products of the shifted points. */
+
+	/*! Adds a point with the given weight. Points with weight <= 0 are ignored. */
+	void add(Eigen::Vector3d const &point, double weight = 1.){
+		if (weight <= 0){
+			return;
+		}
+		if (count == 0){
+			shift = point;
+		}
+		Eigen::Vector3d shifted = point - shift;
+		weightSum += weight;
+		count++;
+		sum += weight*shifted;
+		outerSum.noalias() += weight*shifted*shifted.transpose();
+	}
+
+	/*!
+	 * Computes the least squares plane of the accumulated points, with a closed-form eigen solve of the 3x3 covariance.
+	 * @param[out] plane the plane (a,b,c,d), with (a,b,c) of unit length, so that n.p + d is the signed distance of p to the plane
+	 * @return false if there are less than 3 points, in that case plane is left unchanged
+	 */
+	bool getPlane(Eigen::Vector4d &plane) const{
+		if (count < 3 || weightSum <= 0){
+			return false;
+		}
+		Eigen::Vector3d mean = sum/weightSum;
+		Eigen::Matrix3d covariance = outerSum/weightSum - mean*mean.transpose();
+
+		Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+		solver.computeDirect(covariance, Eigen::ComputeEigenvectors);
+		Eigen::Vector3d normal = solver.eigenvectors().col(0).normalized();	// eigenvalues are sorted increasingly
+
+		plane << normal, -normal.dot(mean + shift);
+		return true;
+	}
+};
 
 
 /**
@@ -17,6 +65,7 @@
  *
  *
  * This class executes RANSAC for the calculation of a plane to fit a number of points.
+ * Every instance draws its samples from its own seeded generator, so fits are reproducible and several instances can fit in parallel.
  *
  * 
  */
@@ -25,20 +74,56 @@ class PlaneFitter {
 
 private:
 
-	const float RANSAC_THRESH = 0.006;
+	Eigen::Vector4d fittedplane;
 
-	Eigen::Vector4d* fittedplane;
+	Eigen::Matrix<double,4,Eigen::Dynamic> Dinliers;
 
-	Eigen::Matrix<double,4,Eigen::Dynamic>* Dinliers;
+	std::mt19937 generator;	/*!< The generator the RANSAC samples are drawn from. */
 
 
 public:
 
+	const float RANSAC_THRESH = 0.006;
+
+	static constexpr int RANSAC_MAX_ITERATIONS = 2000;	/*!< Upper bound of RANSAC iterations. */
+
+	static constexpr int RANSAC_MIN_ITERATIONS = 50;	/*!< Lower bound of RANSAC iterations, the adaptive bound is not trusted earlier. */
+
+	static constexpr double RANSAC_CONFIDENCE = 0.99;	/*!< Probability to draw at least one all-inlier sample (adaptive termination). */
+
+	static constexpr int RANSAC_LOCAL_REFINEMENTS = 3;	/*!< Maximum number of least squares refits of a new best model to its inliers. */
+
+	static constexpr int RANSAC_BLOCK_SIZE = 64;		/*!< Points tested between two early rejection checks. */
+
+	static constexpr double SPRT_INITIAL_DELTA = 0.05;	/*!< Initial estimate of the inlier ratio of a bad model. */
+
+	static constexpr double SPRT_THRESHOLD = 4.6;		/*!< Log-likelihood ratio above which a model is rejected early (about log(100)). */
+
+	static constexpr int IRLS_ITERATIONS = 3;			/*!< Reweighting iterations of the final refit to all inliers. */
+
+	static constexpr unsigned int DEFAULT_SEED = 5489u;	/*!< Default seed of the generator (the default seed of std::mt19937). */
+
 	int numberOfInliers;
-	PlaneFitter();
+
+	/*!
+	 * Constructor.
+	 * @param[in] seed the seed of the generator the RANSAC samples are drawn from
+	 */
+	PlaneFitter(unsigned int seed = DEFAULT_SEED);
+
+	/*!
+	 * Constructor with a given generator, e.g. to continue a sequence of random numbers.
+	 * @param[in] aGenerator the generator the RANSAC samples are drawn from. It is copied.
+	 */
+	PlaneFitter(std::mt19937 const &aGenerator);
 
 	virtual ~PlaneFitter();
 
+	/*!
+	 * Reseeds the generator. Fits with the same seed and the same input give the same result.
+	 */
+	void setSeed(unsigned int seed);
+
 	/*! 
    	 * getter method to retrieve the fitted plane ( in a Vector4d).
 	 *
@@ -53,14 +138,42 @@ public:
 
 	/*! 
    	 * method to execute the ransac and fit a plane.
+	 * The number of iterations adapts to the inlier ratio of the best model so far (RANSAC_CONFIDENCE), and models are tested in blocks of
+	 * points and rejected early once they cannot win (bound on the remaining points, and a sequential probability ratio test).
+	 * The points are tested in an order shuffled with the seeded generator, so the fit is deterministic for a seed.
 	 * @param[in] points3d the 3d points to fit a plane
 	 * @param[in] inputIndices the indices of the input points (indices pointing the initial dataset, inputManager.pointModel)
 	 *
 	 * @return a vector of integers, containing the indices of the inliers (indices pointing the initial dataset, inputManager.pointModel)
 	*/
-	std::vector<int> ransacFit(std::vector<Eigen::Vector3d> points3d, std::vector<int> inputIndices);
-
-	void fitPlane(Eigen::Matrix<double,Eigen::Dynamic,4> Points, Eigen::Vector4d *plane);
+	std::vector<int> ransacFit(std::vector<Eigen::Vector3d> const &points3d, std::vector<int> const &inputIndices);
+
+	/*!
+	 * Fits the least squares plane to the given points in one streaming pass (see PlaneAccumulator).
+	 * @param[in] Points the points in homogeneous coordinates, one per row
+	 * @param[out] plane the plane, with a normal of unit length
+	 * @return false if there are less than 3 points, in that case plane is left unchanged
+	 */
+	static bool fitPlane(Eigen::Matrix<double,Eigen::Dynamic,4> const &Points, Eigen::Vector4d &plane);
+
+	/*!
+	 * Fits the weighted least squares plane to the given points.
+	 * @param[in] Points the points in homogeneous coordinates, one per column
+	 * @param[in] weights the weight of every point, points with weight <= 0 are ignored
+	 * @param[out] plane the plane, with a normal of unit length
+	 * @return false if there are less than 3 points with positive weight, in that case plane is left unchanged
+	 */
+	static bool fitPlaneWeighted(Eigen::Matrix<double,4,Eigen::Dynamic> const &Points, Eigen::VectorXd const &weights, Eigen::Vector4d &plane);
+
+	/*!
+	 * Refines a plane by iteratively reweighted least squares with Cauchy weights w = 1/(1+(r/scale)^2) of the residuals r,
+	 * so that points far from the plane have little influence.
+	 * @param[in] Points the points in homogeneous coordinates, one per column
+	 * @param[in,out] plane the initial plane, the refined plane with a normal of unit length
+	 * @param[in] scale the residual scale of the weights
+	 * @param[in] iterations the number of reweighting iterations
+	 */
+	static void refinePlaneIRLS(Eigen::Matrix<double,4,Eigen::Dynamic> const &Points, Eigen::Vector4d &plane, double scale, int iterations);
 
 
 
@@ -68,10 +181,10 @@ public:
    	 * getter method to get the inliers 3D points, projected into the fitted plane.
 	 *
 	*/
-	std::vector<Eigen::Vector3d> getProjectedInliers();
+	std::vector<Eigen::Vector3d> getProjectedInliers() const;
 
-	static void vecToEigenMat(std::vector<Eigen::Vector3d> in,
-			Eigen::Matrix<double,4,Eigen::Dynamic> &out, std::vector<int> idvec = std::vector<int>()){
+	static void vecToEigenMat(std::vector<Eigen::Vector3d> const &in,
+			Eigen::Matrix<double,4,Eigen::Dynamic> &out, std::vector<int> const &idvec = std::vector<int>()){
 
 		if (idvec.size()==0){
 			for (size_t i = 0;i < in.size();i++){
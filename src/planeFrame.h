@@ -0,0 +1,74 @@
+#ifndef PLANEFRAME_H
+#define PLANEFRAME_H
+
+#include <Eigen/Dense>
+#include <math.h>
+
+/*!< struct to keep an orthonormal coordinate frame in a plane: an origin on the plane, two in-plane axes and the unit normal.
+ * Points on the plane are expressed as origin + a*axisU + b*axisV, with (a,b) their metric 2d plane coordinates. */
+struct PlaneFrame
+{
+	Eigen::Vector3d origin;
+	Eigen::Vector3d axisU;
+	Eigen::Vector3d axisV;
+	Eigen::Vector3d normal;
+
+	PlaneFrame()
+	{
+		origin = Eigen::Vector3d::Zero();
+		axisU = Eigen::Vector3d::UnitX();
+		axisV = Eigen::Vector3d::UnitY();
+		normal = Eigen::Vector3d::UnitZ();
+	}
+
+	/*!
+	 * Builds the frame of a plane.
+	 *
+	 * @param[in] plane			The plane (a,b,c,d), with a*x + b*y + c*z + d = 0.
+	 * @param[in] originHint	A point close to the plane. Its projection onto the plane becomes the origin of the frame.
+	 */
+	PlaneFrame(Eigen::Vector4d const &plane, Eigen::Vector3d const &originHint)
+	{
+		double normalLength = plane.head<3>().norm();
+		normal = plane.head<3>() / normalLength;
+
+		double distance = (originHint.dot(plane.head<3>()) + plane(3)) / normalLength;
+		origin = originHint - normal*distance;
+
+		// start from the canonical axis that is least aligned with the normal, to stay well conditioned
+		Eigen::Vector3d::Index minIndex;
+		normal.cwiseAbs().minCoeff(&minIndex);
+		Eigen::Vector3d helper = Eigen::Vector3d::Zero();
+		helper(minIndex) = 1;
+
+		axisU = (helper - normal*normal.dot(helper)).normalized();
+		axisV = normal.cross(axisU);
+	}
+
+	/*! Returns the 2d plane coordinates of a 3d point (the point is projected onto the plane). */
+	Eigen::Vector2d toPlane(Eigen::Vector3d const &point) const
+	{
+		Eigen::Vector3d relative = point - origin;
+		return Eigen::Vector2d(relative.dot(axisU), relative.dot(axisV));
+	}
+
+	/*! Returns the 2d plane coordinates of a 3d direction (the direction is projected onto the plane). */
+	Eigen::Vector2d directionToPlane(Eigen::Vector3d const &direction) const
+	{
+		return Eigen::Vector2d(direction.dot(axisU), direction.dot(axisV));
+	}
+
+	/*! Returns the 3d point with the given 2d plane coordinates. */
+	Eigen::Vector3d fromPlane(Eigen::Vector2d const &coordinates) const
+	{
+		return origin + axisU*coordinates(0) + axisV*coordinates(1);
+	}
+
+	/*! Returns the 3d direction with the given 2d plane coordinates. */
+	Eigen::Vector3d directionFromPlane(Eigen::Vector2d const &coordinates) const
+	{
+		return axisU*coordinates(0) + axisV*coordinates(1);
+	}
+};
+
+#endif
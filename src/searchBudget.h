@@ -0,0 +1,118 @@
+#ifndef SEARCHBUDGET_H
+#define SEARCHBUDGET_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+using namespace std;
+
+/**
+ * \class SearchBudget
+ *
+ *
+ * Limits the work spent on the lattice search of one group. The search checks the budget in its open-ended loops and stops early
+ * when it is exhausted, keeping the best result found so far. The budget is exhausted if
+ * - the cancellation token was set (it may be shared by many groups, to stop a whole batch),
+ * - more time than maxSeconds passed since start(), or
+ * - more than maxSteps grid points were validated.
+ * Limits <= 0 are unlimited. All methods may be called from several threads at once.
+ *
+ */
+class SearchBudget {
+
+public:
+
+	/*! The reasons for the search to stop. */
+	enum StopReason{NOT_STOPPED, CANCELLED, TIME_BUDGET, STEP_BUDGET};
+
+	/*!
+	 * The constructor. Starts the clock.
+	 *
+	 * @param[in] aMaxSeconds			The time budget in seconds, <= 0 for unlimited.
+	 * @param[in] aMaxSteps				The step budget (validated grid points), <= 0 for unlimited.
+	 * @param[in] aCancellationToken	The cancellation token, may be NULL.
+	 */
+	SearchBudget(double aMaxSeconds, long aMaxSteps, shared_ptr<atomic<bool> > aCancellationToken){
+		maxSeconds = aMaxSeconds;
+		maxSteps = aMaxSteps;
+		cancellationToken = aCancellationToken;
+		steps = 0;
+		stopReason = NOT_STOPPED;
+		start = chrono::steady_clock::now();
+	}
+
+	/*! Counts validated grid points. */
+	void addSteps(long count){
+		steps += count;
+	}
+
+	/*!
+	 * Checks whether the budget is exhausted. Once exhausted, it stays exhausted and the first reason is kept.
+	 */
+	bool exhausted(){
+		if (stopReason != NOT_STOPPED){
+			return true;
+		}
+
+		StopReason reason = NOT_STOPPED;
+		if (cancellationToken && cancellationToken->load()){
+			reason = CANCELLED;
+		}
+		else if ((maxSteps > 0) && (steps.load() > maxSteps)){
+			reason = STEP_BUDGET;
+		}
+		else if ((maxSeconds > 0) && (elapsedSeconds() > maxSeconds)){
+			reason = TIME_BUDGET;
+		}
+
+		if (reason != NOT_STOPPED){
+			int expected = NOT_STOPPED;
+			stopReason.compare_exchange_strong(expected, reason);
+			return true;
+		}
+
+		return false;
+	}
+
+	/*! Returns the reason why the budget was exhausted, NOT_STOPPED if it was not (yet). */
+	StopReason getStopReason() const{
+		return (StopReason)stopReason.load();
+	}
+
+	/*! Returns the number of validated grid points so far. */
+	long getSteps() const{
+		return steps.load();
+	}
+
+	/*! Returns the seconds since the budget was created. */
+	double elapsedSeconds() const{
+		return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+
+private:
+
+	double maxSeconds;	/*!< The time budget in seconds, <= 0 for unlimited. */
+
+	long maxSteps;		/*!< The step budget, <= 0 for unlimited. */
+
+	shared_ptr<atomic<bool> > cancellationToken;	/*!< Set to true to cancel the search. May be NULL. */
+
+	atomic<long> steps;	/*!< The number of validated grid points. */
+
+	atomic<int> stopReason;	/*!< The first reason the budget was found exhausted. */
+
+	chrono::steady_clock::time_point start;	/*!< The time the budget was created. */
+};
+
+/*!< struct to keep statistics about the lattice fit of one group */
+struct LatticeFitStats
+{
+	double seconds = 0;					/*!< Wall time of the fit. */
+	long validatedGridPoints = 0;		/*!< Number of grid points whose validity was determined. */
+	int candidateVectors = 0;			/*!< Number of candidate basis vectors. */
+	SearchBudget::StopReason stopReason = SearchBudget::NOT_STOPPED;	/*!< Why the search was stopped early, if it was. */
+	bool partialScores = false;			/*!< Whether the candidate vectors were scored on only part of the reference points (see LatticeDetector::hasPartialScores). */
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef UNIONFIND_H
+#define UNIONFIND_H
+
+#include <vector>
+
+using namespace std;
+
+/*!< struct for a disjoint-set forest over the elements 0..n-1, with path halving and union by size.
+ * Used to merge elements into connected components when only pairs of connected elements are known. */
+struct UnionFind
+{
+	vector<int> parent;
+	vector<int> size;
+
+	UnionFind(int n)
+	{
+		parent = vector<int>(n);
+		size = vector<int>(n, 1);
+		for (int i = 0; i < n; i++)
+		{
+			parent[i] = i;
+		}
+	}
+
+	/*! Returns the representative of the component of element i. */
+	int find(int i)
+	{
+		while (parent[i] != i)
+		{
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	}
+
+	/*! Merges the components of elements i and j. Returns false if they were already in the same component. */
+	bool unite(int i, int j)
+	{
+		i = find(i);
+		j = find(j);
+		if (i == j)
+		{
+			return false;
+		}
+		if (size[i] < size[j])
+		{
+			swap(i, j);
+		}
+		parent[j] = i;
+		size[i] += size[j];
+		return true;
+	}
+};
+
+#endif